@@ -1,12 +1,18 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <new>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "lexer_token.hpp"
+#include "arena.hpp"
+
+class Variable;
 
 namespace AST {
-  enum class NodeType {
+  enum class NodeType : uint8_t {
     Statements,
     Variable,
     Value,
@@ -15,139 +21,338 @@ namespace AST {
     Function,
     Parameters,
     IfStatement,
-    WhileStatement,
-    Type
+    WhileStatement
+  };
+
+  // A node: its kind, and its index in the array of that kind in a Tree.
+  // The null node is of no kind.
+  class NodeId {
+  private:
+    static constexpr uint32_t INDEX_BITS = 28;
+    static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+    uint32_t bits;
+
+  public:
+    // The nodes a kind can have
+    static constexpr size_t MAX_NODES = INDEX_MASK;
+
+    NodeId() : bits(UINT32_MAX) {}
+    NodeId(NodeType type_, size_t index_)
+      : bits(static_cast<uint32_t>(type_) << INDEX_BITS | static_cast<uint32_t>(index_)) {}
+
+    NodeType type() const { return static_cast<NodeType>(bits >> INDEX_BITS); }
+    uint32_t index() const { return bits & INDEX_MASK; }
+
+    explicit operator bool() const { return bits != UINT32_MAX; }
+    bool operator ==(NodeId other) const { return bits == other.bits; }
+    bool operator !=(NodeId other) const { return bits != other.bits; }
+  };
+
+  static_assert(sizeof(NodeId) == 4, "NodeId must stay compact");
+
+  // A fixed run of children, stored contiguously in the arena of the tree
+  class NodeList {
+  private:
+    const NodeId *items;
+    uint32_t count;
+
+  public:
+    NodeList() : items(nullptr), count(0) {}
+    NodeList(const NodeId *items_, size_t count_) : items(items_), count(static_cast<uint32_t>(count_)) {}
+
+    const NodeId *begin() const { return items; }
+    const NodeId *end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    NodeId operator [](size_t i) const { return items[i]; }
+  };
+
+  // The base types. Types are compared by these, and the machine types
+  // of each are in a table indexed by them.
+  enum class TypeId : uint8_t {
+    // Not known yet
+    None,
+    // An integer constant, which takes the type of what it meets
+    CtInt,
+    I64,
+    I32,
+    Byte,
+    Void,
+    // A name that isn't a type, reported where it is declared
+    Unknown
   };
 
+  TypeId typeByName(std::string_view name);
+
   class Type {
   public:
-    std::string type;
-    size_t pointerLevel;
+    // The modifiers a type can have
+    static constexpr size_t MAX_POINTER_LEVEL = UINT16_MAX;
+
+    TypeId base;
     bool isPointer;
+    uint16_t pointerLevel;
 
-    bool operator ==(const Type &t);
-    bool operator !=(const Type &t);
-    bool isNull();
+    bool operator ==(const Type &t) const;
+    bool operator !=(const Type &t) const;
+    bool isNull() const;
 
     Type();
-    Type(std::string type_, size_t ptrlvl, bool isPtr);
+    Type(TypeId base_, size_t ptrlvl, bool isPtr);
   };
 
+  static_assert(sizeof(Type) == 4, "Type must stay compact");
 
-  class Node {
+  // An operator token: operators have no value to keep
+  class OperatorToken {
   public:
-    NodeType type;
-    Lexer::Token &begin;
-    Type exprType;
+    uint32_t offset;
+    uint16_t length;
+    Lexer::OperatorType operatorType;
 
-    virtual void printJSON(std::string spaces = " ");
+    explicit OperatorToken(const Lexer::Token &tok);
 
-    Node(const NodeType T, Lexer::Token &beg);
-    virtual ~Node();
+    std::string_view value(std::string_view source) const;
   };
 
-  class StatementsNode : public Node {
-  public:
-    std::vector<Node*> statements;
-    Type exprType;
+  // The nodes of each kind. They have no children of their own: they
+  // name them by NodeId. Expressions begin where their token does.
 
-    void printJSON(std::string spaces) override;
+  class StatementsNode {
+  public:
+    uint32_t begin;
+    NodeList statements;
 
-    StatementsNode(Lexer::Token &beg);
-    ~StatementsNode();
-    void addNode(Node *node);
+    StatementsNode(const Lexer::Token &beg, NodeList stmts);
   };
 
-  class VariableNode : public Node {
+  class VariableNode {
   public:
-    Lexer::Token &varTypeToken;
-    Lexer::Token &name;
-    std::vector<Node*> modifiers;
-    Node *body;
+    uint32_t begin;
+    Type exprType;
+    Lexer::Token varTypeToken;
+    Lexer::Token name;
+    NodeList modifiers;
+    NodeId body;
     bool isExtern;
     bool isDefined;
+    // The variable declared, once known
+    Variable *variable;
 
-    void printJSON(std::string spaces) override;
-    VariableNode(Lexer::Token &T, std::vector<Node*> &mods, Lexer::Token &var, Node *val, bool isext, Lexer::Token &beg);
-    VariableNode(Lexer::Token &var, Lexer::Token &beg);
-    ~VariableNode() override;
+    VariableNode(const Lexer::Token &T, const Type &exprType_, NodeList mods, const Lexer::Token &var, NodeId val,
+                 bool isext, const Lexer::Token &beg);
   };
 
-  class ValueNode : public Node {
+  class ValueNode {
   public:
-    Lexer::Token &value;
-
-    void printJSON(std::string spaces) override;
+    Lexer::Token value;
+    Type exprType;
+    // The variable an identifier names, once bound
+    Variable *variable;
 
-    ValueNode(Lexer::Token &val, Lexer::Token &beg);
+    explicit ValueNode(const Lexer::Token &val);
   };
 
-  class BinaryNode : public Node {
+  class BinaryNode {
   public:
-    Lexer::Token &op;
-    Node *left;
-    Node *right;
-
-    void printJSON(std::string spaces) override;
+    OperatorToken op;
+    Type exprType;
+    NodeId left;
+    NodeId right;
 
-    BinaryNode(Lexer::Token &op_, Node *left_, Node *right_, Lexer::Token &beg);
-    ~BinaryNode() override;
+    BinaryNode(const Lexer::Token &op_, NodeId left_, NodeId right_);
   };
 
-  class UnaryNode : public Node {
+  // A prefix operator, a return, or a call of op with the arguments in node
+  class UnaryNode {
   public:
-    Lexer::Token &op;
-    Node *node;
-
-    void printJSON(std::string spaces) override;
+    Lexer::Token op;
+    Type exprType;
+    NodeId node;
 
-    UnaryNode(Lexer::Token &op_, Node *node_, Lexer::Token &beg);
-    ~UnaryNode() override;
+    UnaryNode(const Lexer::Token &op_, NodeId node_);
   };
 
-  class ParametersNode : public Node {
+  class ParametersNode {
   public:
-    std::vector<Node*> parameters;
-
-    void printJSON(std::string spaces) override;
-    void addParameter(Node *parameter);
+    uint32_t begin;
+    NodeList parameters;
 
-    ParametersNode(Lexer::Token &beg);
-    ~ParametersNode() override;
+    ParametersNode(const Lexer::Token &beg, NodeList params);
   };
 
   class FunctionNode : public VariableNode {
   public:
-    ParametersNode *parameters;
+    // Of the Parameters kind
+    NodeId parameters;
 
-    void printJSON(std::string spaces) override;
-
-    FunctionNode(Lexer::Token &T, std::vector<Node*> mods, Lexer::Token &name_,
-                 ParametersNode *parameters_, Node *body_, bool isext, Lexer::Token &beg);
-    ~FunctionNode() override;
+    FunctionNode(const Lexer::Token &T, const Type &exprType_, NodeList mods, const Lexer::Token &name_,
+                 NodeId parameters_, NodeId body_, bool isext, const Lexer::Token &beg);
   };
 
-  class IfStatementNode : public Node {
+  class IfStatementNode {
   public:
-    Node *condition;
-    Node *ifstatement;
-    Node *elsestatement;
+    uint32_t begin;
+    NodeId condition;
+    NodeId ifstatement;
+    NodeId elsestatement;
+
+    IfStatementNode(NodeId cond, NodeId ifstat, NodeId elsestat, const Lexer::Token &beg);
+  };
 
-    void printJSON(std::string spaces) override;
+  // A while, or a for whose condition is the Parameters of its three parts
+  class CycleStatementNode {
+  public:
+    uint32_t begin;
+    NodeId condition;
+    NodeId statement;
 
-    IfStatementNode(Node *cond, Node *ifstat, Node *elsestat, Lexer::Token &beg);
-    ~IfStatementNode() override;
+    CycleStatementNode(NodeId cond, NodeId stat, const Lexer::Token &beg);
   };
 
-  class CycleStatementNode : public Node {
+  // The nodes of one kind, in blocks of the arena. Blocks double in size up
+  // to a limit, so a tree of a few nodes stays small. Blocks never move, so
+  // a node can be pointed at while more are added.
+  template<typename T>
+  class NodeArray {
+  private:
+    static constexpr uint32_t FIRST_BLOCK_BITS = 4;
+    static constexpr uint32_t LAST_BLOCK_BITS = 12;
+    static constexpr uint32_t FIRST_BLOCK_SIZE = 1u << FIRST_BLOCK_BITS;
+    static constexpr uint32_t LAST_BLOCK_SIZE = 1u << LAST_BLOCK_BITS;
+
+    std::vector<T*> blocks;
+    size_t count = 0;
+
+    // Nodes are numbered from FIRST_BLOCK_SIZE. Block k of the growing
+    // ones holds the numbers whose top bit is FIRST_BLOCK_BITS + k.
+    T &at(uint32_t index) const {
+      uint32_t slot = index + FIRST_BLOCK_SIZE;
+
+      if(slot >= LAST_BLOCK_SIZE)
+        return blocks[(slot >> LAST_BLOCK_BITS) + LAST_BLOCK_BITS - FIRST_BLOCK_BITS - 1][slot & (LAST_BLOCK_SIZE - 1)];
+
+      uint32_t bit = 31 - static_cast<uint32_t>(__builtin_clz(slot));
+
+      return blocks[bit - FIRST_BLOCK_BITS][slot - (1u << bit)];
+    }
+
   public:
-    Node *condition;
-    Node *statement;
+    T &operator [](uint32_t index) { return at(index); }
+    const T &operator [](uint32_t index) const { return at(index); }
+    size_t size() const { return count; }
+
+    size_t push(Arena &arena, const T &node) {
+      auto slot = static_cast<uint32_t>(count + FIRST_BLOCK_SIZE);
+
+      if(slot < LAST_BLOCK_SIZE ? (slot & (slot - 1)) == 0 : (slot & (LAST_BLOCK_SIZE - 1)) == 0) {
+        size_t size = slot < LAST_BLOCK_SIZE ? slot : LAST_BLOCK_SIZE;
+        blocks.push_back(static_cast<T*>(arena.allocate(size * sizeof(T), alignof(T))));
+      }
 
-    void printJSON(std::string spaces) override;
+      new(&at(static_cast<uint32_t>(count))) T(node);
 
-    CycleStatementNode(Node *cond, Node *stat, Lexer::Token &beg);
-    ~CycleStatementNode() override;
+      return count++;
+    }
+
+    void clear() {
+      blocks.clear();
+      count = 0;
+    }
+  };
+
+  // The nodes of a parse, an array for each kind, and the lists of their
+  // children. Nodes are never destructed, so they must not own anything
+  // outside of the arena.
+  class Tree {
+  private:
+    NodeArray<StatementsNode> statementsNodes;
+    NodeArray<VariableNode> variableNodes;
+    NodeArray<ValueNode> valueNodes;
+    NodeArray<BinaryNode> binaryNodes;
+    NodeArray<UnaryNode> unaryNodes;
+    NodeArray<FunctionNode> functionNodes;
+    NodeArray<ParametersNode> parametersNodes;
+    NodeArray<IfStatementNode> ifStatementNodes;
+    NodeArray<CycleStatementNode> cycleStatementNodes;
+    size_t nodesMade = 0;
+
+    template<typename T>
+    NodeId add(NodeArray<T> &nodes, NodeType type, const T &node) {
+      if(nodes.size() == NodeId::MAX_NODES)
+        return NodeId();
+
+      ++nodesMade;
+      return NodeId(type, nodes.push(arena, node));
+    }
+
+    NodeList cloneList(const Tree &from, NodeList list);
+    NodeId clone(const Tree &from, NodeId node);
+
+  public:
+    Arena arena;
+
+    Tree() = default;
+    Tree(const Tree &) = delete;
+    Tree &operator =(const Tree &) = delete;
+
+    // The node made, or the null node when there are too many of its kind
+    NodeId add(const StatementsNode &node) { return add(statementsNodes, NodeType::Statements, node); }
+    NodeId add(const VariableNode &node) { return add(variableNodes, NodeType::Variable, node); }
+    NodeId add(const ValueNode &node) { return add(valueNodes, NodeType::Value, node); }
+    NodeId add(const BinaryNode &node) { return add(binaryNodes, NodeType::BinaryOperator, node); }
+    NodeId add(const UnaryNode &node) { return add(unaryNodes, NodeType::UnaryOperator, node); }
+    NodeId add(const FunctionNode &node) { return add(functionNodes, NodeType::Function, node); }
+    NodeId add(const ParametersNode &node) { return add(parametersNodes, NodeType::Parameters, node); }
+    NodeId add(const IfStatementNode &node) { return add(ifStatementNodes, NodeType::IfStatement, node); }
+    NodeId add(const CycleStatementNode &node) { return add(cycleStatementNodes, NodeType::WhileStatement, node); }
+
+    // Copies a list of children into the arena
+    NodeList list(const NodeId *items, size_t count);
+
+    // A node of the kind asked for
+    StatementsNode &statements(NodeId node) { return statementsNodes[node.index()]; }
+    VariableNode &variable(NodeId node) { return variableNodes[node.index()]; }
+    ValueNode &value(NodeId node) { return valueNodes[node.index()]; }
+    BinaryNode &binary(NodeId node) { return binaryNodes[node.index()]; }
+    UnaryNode &unary(NodeId node) { return unaryNodes[node.index()]; }
+    FunctionNode &function(NodeId node) { return functionNodes[node.index()]; }
+    ParametersNode &parameters(NodeId node) { return parametersNodes[node.index()]; }
+    IfStatementNode &ifStatement(NodeId node) { return ifStatementNodes[node.index()]; }
+    CycleStatementNode &cycleStatement(NodeId node) { return cycleStatementNodes[node.index()]; }
+
+    const StatementsNode &statements(NodeId node) const { return statementsNodes[node.index()]; }
+    const VariableNode &variable(NodeId node) const { return variableNodes[node.index()]; }
+    const ValueNode &value(NodeId node) const { return valueNodes[node.index()]; }
+    const BinaryNode &binary(NodeId node) const { return binaryNodes[node.index()]; }
+    const UnaryNode &unary(NodeId node) const { return unaryNodes[node.index()]; }
+    const FunctionNode &function(NodeId node) const { return functionNodes[node.index()]; }
+    const ParametersNode &parameters(NodeId node) const { return parametersNodes[node.index()]; }
+    const IfStatementNode &ifStatement(NodeId node) const { return ifStatementNodes[node.index()]; }
+    const CycleStatementNode &cycleStatement(NodeId node) const { return cycleStatementNodes[node.index()]; }
+
+    // Where the text of a node begins
+    uint32_t begin(NodeId node) const;
+    // The type of an expression or a declaration
+    Type &exprType(NodeId node);
+
+    // A name used as a value
+    bool isVariable(NodeId node) const {
+      return node.type() == NodeType::Value && value(node).value.type == Lexer::Type::Identifier;
+    }
+
+    // Copies a declaration of another tree into this one, for one that must
+    // outlive the tree it was parsed into. Only the signature of a function
+    // is copied.
+    NodeId cloneDeclaration(const Tree &from, NodeId node);
+
+    // Drops every node. The arena keeps its last block for reuse.
+    void reset();
+
+    // The nodes made so far, those dropped included
+    size_t nodeCount() const;
   };
 
+  void printJSON(const Tree &tree, NodeId node, std::string_view source, std::string spaces = " ");
 }
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counts the allocations made with operator new, so the allocations of a
+// phase are the difference of the counts around it. Each thread counts its
+// own, so phases that run at the same time on other threads don't count;
+// the tasks of a phase are added up by TimeReport::Charge. Nothing is
+// counted until counting is enabled.
+namespace Allocations {
+  class Counts {
+  public:
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    Counts operator -(const Counts &other) const {
+      return { allocations - other.allocations, bytes - other.bytes };
+    }
+  };
+
+  void enable();
+  // The counts of the calling thread
+  Counts current();
+}
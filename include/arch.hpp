@@ -1,18 +1,39 @@
 #pragma once
 
+#include "AST.hpp"
 #include "asmtype.hpp"
-#include <string>
+#include "mir.hpp"
 
-#define NAT_TYPE "qword"
+#define NAT_TYPE MIR::Size::Qword
 #define NAT_TYPE_SIZE 8
-#define NAT_AX "rax"
-#define NAT_BX "rbx"
-#define NAT_DX "rdx"
-#define NAT_BP "rbp"
-#define NAT_SP "rsp"
+#define NAT_AX MIR::Reg::RAX
+#define NAT_BX MIR::Reg::RBX
+#define NAT_DX MIR::Reg::RDX
+#define NAT_BP MIR::Reg::RBP
+#define NAT_SP MIR::Reg::RSP
 
-static AssemblerType NAT_ASMTYPE("qword", { "rax", "rbx", "rcx", "rdx" }, 8);
+inline constexpr AssemblerType NAT_ASMTYPE = { MIR::Size::Qword, { MIR::Reg::RAX, MIR::Reg::RBX }, 8 };
 
-static std::string parametersRegList[] = {
-  "rdi", "rsi", "rdx", "r10", "r8", "r5"
+static const MIR::Reg parametersRegList[] = {
+  MIR::Reg::RDI, MIR::Reg::RSI, MIR::Reg::RDX, MIR::Reg::R10, MIR::Reg::R8, MIR::Reg::R9
 };
+
+// The machine types of the base types, indexed by AST::TypeId
+inline constexpr AssemblerType ASM_TYPES[] = {
+  /* None */    { MIR::Size::None,  { MIR::Reg::RAX, MIR::Reg::RBX }, 0 },
+  /* CtInt */   { MIR::Size::Qword, { MIR::Reg::RAX, MIR::Reg::RBX }, 8 },
+  /* I64 */     { MIR::Size::Qword, { MIR::Reg::RAX, MIR::Reg::RBX }, 8 },
+  /* I32 */     { MIR::Size::Dword, { MIR::Reg::EAX, MIR::Reg::EBX }, 4 },
+  /* Byte */    { MIR::Size::Byte,  { MIR::Reg::AL,  MIR::Reg::BL },  1 },
+  /* Void */    { MIR::Size::None,  { MIR::Reg::RAX, MIR::Reg::RBX }, 0 },
+  /* Unknown */ { MIR::Size::None,  { MIR::Reg::RAX, MIR::Reg::RBX }, 0 }
+};
+
+inline const AssemblerType &asmType(AST::TypeId base) {
+  return ASM_TYPES[static_cast<size_t>(base)];
+}
+
+// Pointers are held as native integers whatever they point to
+inline const AssemblerType &asmType(const AST::Type &type) {
+  return type.pointerLevel != 0 ? NAT_ASMTYPE : asmType(type.base);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace AST {
+  // Bump-pointer allocator for everything a parse produces. Memory is taken
+  // from the system in large blocks and only given back, all at once, when
+  // the arena is reset or destroyed; nothing allocated here is ever
+  // destructed.
+  class Arena : public std::pmr::memory_resource {
+  private:
+    std::vector<void*> blocks;
+    char *cursor;
+    char *limit;
+    size_t nextBlockSize;
+    size_t systemAllocations;
+    size_t allocations;
+    size_t bytes;
+
+    void newBlock(size_t minSize);
+
+  protected:
+    void *do_allocate(size_t size, size_t alignment) override;
+    void do_deallocate(void *ptr, size_t size, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+  public:
+    Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator =(const Arena &) = delete;
+    ~Arena() override;
+
+    // Drops everything allocated so far. The last block is kept for reuse.
+    void reset();
+
+    // Allocation counters: blockCount() is the number of system
+    // allocations, allocationCount() the number of allocations served
+    size_t blockCount() const;
+    size_t allocationCount() const;
+    size_t bytesAllocated() const;
+  };
+}
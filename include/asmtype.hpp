@@ -1,15 +1,14 @@
 #pragma once
 
-#include <string>
-#include <vector>
+#include <cstddef>
+#include "mir.hpp"
 
+// How the machine holds values of a type: the size of the memory operands
+// and the registers that take them, the accumulator first. There is one
+// of each, in a static table, that variables point to.
 class AssemblerType {
 public:
-  std::string asmname;
-  std::vector<std::string> baseRegs;
+  MIR::Size width;
+  MIR::Reg baseRegs[2];
   size_t size;
-
-  AssemblerType(std::string name, std::vector<std::string> baseregs, size_t sz);
-  AssemblerType();
 };
-
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Compiled functions kept on disk between runs. An entry is a file named
+// after a hash of its key that holds the key itself, so a collision of
+// hashes is a miss rather than wrong code. Keys are made unique to the
+// compiler binary, whose output may change from one build to the next.
+// A server keeps the entries in memory too, with or without a directory.
+namespace Cache {
+  class Cache {
+  private:
+    std::string directory;
+    std::string compilerIdentity;
+    bool inMemory;
+    std::mutex memoryMutex;
+    // Entries in memory by the hash of their key; of keys with the same
+    // hash only the last one stored is kept
+    struct Entry {
+      std::string key;
+      std::shared_ptr<const std::string> value;
+    };
+    std::unordered_map<uint64_t, Entry> memory;
+    size_t memorySize;
+
+    std::string path(std::string_view key) const;
+    void remember(std::string_view key, std::shared_ptr<const std::string> value);
+
+  public:
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+
+    Cache(std::string directory_, bool inMemory_ = false);
+
+    // The entry, shared with the memory of the cache, or null
+    std::shared_ptr<const std::string> load(std::string_view key);
+    // Entries are written under a temporary name and renamed, so the
+    // compilers sharing a directory never read half of one
+    void store(std::string_view key, std::string value);
+  };
+}
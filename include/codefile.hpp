@@ -1,15 +1,38 @@
 #pragma once
 
-#include <sstream>
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <vector>
 
 namespace CodeFile {
   class CodeFile {
+  private:
+    void *mapping;
+    size_t mappingSize;
+    std::string buffer;
+
+    void readStream();
+    void indexLines();
+
   public:
+    // The largest source that can be compiled, as offsets into it are
+    // 32-bit. Larger ones aren't indexed.
+    static constexpr size_t MAX_SIZE = UINT32_MAX;
+
     std::string fileName;
-    std::string fileData;
+    std::string_view fileData;
+    std::vector<uint32_t> lineBegins;
+    // False if the file couldn't be opened; it is read as empty then
+    bool readable;
 
     CodeFile(const std::string &filename);
+    CodeFile(const CodeFile &) = delete;
+    CodeFile &operator =(const CodeFile &) = delete;
+    ~CodeFile();
+
+    size_t getLineNumber(size_t offset) const;
+    bool tooLarge() const;
   };
 }
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <variant>
@@ -10,51 +15,134 @@
 #include "AST.hpp"
 #include "variable.hpp"
 #include "scope.hpp"
+#include "output_buffer.hpp"
+#include "mir.hpp"
+#include "elf.hpp"
+
+class ThreadPool;
+
+namespace Cache {
+  class Cache;
+}
+
+namespace TimeReport {
+  class Report;
+}
 
 namespace Compiler {
+  enum class Output {
+    // NASM source
+    Assembly,
+    // An ELF64 relocatable object, as nasm -felf64 makes of the assembly
+    Object,
+    // The same object, kept in memory to be run
+    Memory
+  };
+
   class NonsenseCompiler {
   private:
-    AST::StatementsNode &tree;
-    GlobalScope global;
+    // What the compilers of all the functions of a file share. Once the
+    // declarations are collected it is only read.
+    struct Module {
+      GlobalScope global;
+      // Copies of the declarations kept when their trees are freed
+      AST::Tree declarations;
+      Output format = Output::Assembly;
+      Cache::Cache *cache = nullptr;
+      // Where the top-level declarations begin, which bounds the text
+      // of each
+      std::vector<uint32_t> declarationBegins;
+      // Nanoseconds spent in the semantic analysis, summed over the threads
+      std::atomic<int64_t> analysisTime{0};
+    };
+
+    std::string_view source;
+    std::shared_ptr<Module> module;
+    GlobalScope &global;
+    // The tree of the declarations, or of the function, being compiled
+    AST::Tree *tree;
     Scope *currentScope;
 
-    std::unordered_map<std::string, AssemblerType> typesMap;
-
-    std::string convertStringToNumbers(std::string str);
-    AST::Type getValueType(AST::ValueNode *val);
-    Variable &getVariable(AST::ValueNode *val);
-    AST::Type getExpressionType(AST::Node *node);
-    bool compareOperandsTypes(AST::Type &first, AST::Type &second);
-    void compileStatement(AST::Node *stmt);
-    void compileStatements(AST::StatementsNode *stmts);
-    void compileAssign(AST::BinaryNode *bin);
-    void compileFormula(AST::Node *val);
-    void compileAssignLeftOperand(AST::Node *opd);
-    void compileOptimizableBinaryOperator(AST::BinaryNode *bin);
-    void compileNotOptimizableBinaryOperator(AST::BinaryNode *bin);
-    void compileBinary(AST::BinaryNode *bin);
-    void compileUnary(AST::UnaryNode *unr);
-    void compileCall(AST::UnaryNode *fn);
-    void compileVariableAddress(AST::ValueNode *varNode);
-    void compileGlobalVariable(AST::ValueNode *varNode);
-    void compileLocalVariable(AST::ValueNode *varNode);
-    void compileVariable(AST::ValueNode *varNode);
-    void compileVariableDeclaration(AST::VariableNode *var);
-    void compileAsmIncluding(AST::ParametersNode *strings);
-    void compileIfStatement(AST::IfStatementNode *ifstat);
-    void compileWhileStatement(AST::CycleStatementNode *whilestat);
-    void compileForStatement(AST::CycleStatementNode *forstat);
-    void compileCycleStatement(AST::CycleStatementNode *whilestat);
-    void compileValue(AST::ValueNode *val);
-    void compileIndexToAssign(AST::BinaryNode *bin);
-    void compileIndexInFormula(AST::BinaryNode *bin);
-    void compileIndex(AST::BinaryNode *bin);
-    void compileFunctionDeclaration(AST::FunctionNode *funcNode);
+    // Functions and global variables in source order, the first
+    // definition of each name only
+    std::vector<Function*> functions;
+    std::vector<Variable*> variables;
+
+    // Where a streaming compiler writes the code
+    OutputBuffer *stream;
+
+    NonsenseCompiler(const NonsenseCompiler &parent, Function &func);
+
+    std::string_view value(const Lexer::Token &tok);
+    std::string stringLiteralLabel(const Scope &scope, size_t number);
+    MIR::Code::Position emit(MIR::Opcode opcode, const MIR::Operand &first = MIR::Operand(), const MIR::Operand &second = MIR::Operand());
+    MIR::Operand local(const Variable &var);
+    void compileStatement(AST::NodeId stmt);
+    void compileStatements(AST::NodeId stmts);
+    void compileAssign(AST::BinaryNode &bin);
+    void compileFormula(AST::NodeId val);
+    void compileAssignLeftOperand(AST::NodeId opd);
+    void compileOptimizableBinaryOperator(AST::BinaryNode &bin);
+    void compileNotOptimizableBinaryOperator(AST::BinaryNode &bin);
+    void compileOperator(AST::BinaryNode &bin, MIR::Operand right);
+    void compileBinary(AST::BinaryNode &bin);
+    void compileUnary(AST::UnaryNode &unr);
+    void compileCall(AST::UnaryNode &fn);
+    void compileVariableAddress(AST::ValueNode &varNode);
+    void compileGlobalVariable(AST::ValueNode &varNode);
+    void compileLocalVariable(AST::ValueNode &varNode);
+    void compileVariable(AST::ValueNode &varNode);
+    void compileVariableDeclaration(AST::VariableNode &var);
+    void compileAsmIncluding(AST::NodeId strings);
+    void compileIfStatement(const AST::IfStatementNode &ifstat);
+    void compileWhileStatement(const AST::CycleStatementNode &whilestat);
+    void compileForStatement(const AST::CycleStatementNode &forstat);
+    void compileCycleStatement(const AST::CycleStatementNode &whilestat);
+    void compileValue(AST::ValueNode &val);
+    void compileIndexToAssign(AST::BinaryNode &bin);
+    void compileIndexInFormula(AST::BinaryNode &bin);
+    void compileIndex(AST::BinaryNode &bin);
+    void lowerBlocks(Function &func, size_t first, size_t last);
+    void lowerFinishedBlocks(Function &func);
+    void compileFunctionDeclaration(Function &func);
+    bool declareStatement(AST::NodeId stmt);
+    std::string_view declarationText(uint32_t begin);
+    std::string cacheKey(const Function &func);
+    bool loadCached(Function &func, const std::string &key);
+    void storeCached(Function &func, const std::string &key);
+    void compileFunctions(ThreadPool *pool);
+    void writeDataSections(OutputBuffer &code);
     void finalAssembly();
+    void finalObject();
     
   public:
-    std::string asmCode;
-    NonsenseCompiler(AST::StatementsNode &tree_);
+    // The assembly, or the object file
+    OutputBuffer output;
+    // The object file before it is written, or when compiling to memory
+    ELF::ObjectFile object;
+
+    // Global declarations are collected first, so functions can be compiled
+    // independently; with a pool they are compiled in parallel. The output
+    // is the same either way. With a cache, functions whose text and
+    // whose references are unchanged are taken from it. With a report, the
+    // phase of the functions is ended before the output is put together.
+    NonsenseCompiler(AST::Tree &tree_, AST::NodeList declarations, std::string_view source_,
+                     ThreadPool *pool = nullptr, Output format = Output::Assembly, Cache::Cache *cache = nullptr,
+                     TimeReport::Report *report = nullptr);
+
+    // Streaming: every declaration is compiled as soon as it is parsed and
+    // its code written to out, after which its tree can be freed. Only the
+    // symbols and the data sections are kept, which finish() writes.
+    // Names must be declared before they are used.
+    NonsenseCompiler(AST::Tree &tree_, std::string_view source_, OutputBuffer &out);
+    void compileDeclaration(AST::NodeId decl);
+    void finish();
+
+    // The time spent in the semantic analysis of the functions compiled,
+    // summed over the threads; cached functions aren't analyzed
+    std::chrono::nanoseconds analysisTime() const;
+    // The functions declared, the first definition of each name only
+    size_t functionCount() const;
 
   };
 }
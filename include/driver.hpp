@@ -0,0 +1,77 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+namespace Cache {
+  class Cache;
+}
+
+namespace Driver {
+  class Options {
+  public:
+    bool printStats = false;
+    // Print the time and the memory of every phase, see TimeReport::Report,
+    // as a table or as a line of JSON
+    bool timeReport = false;
+    bool timeReportJson = false;
+    // Compile each declaration as soon as it is parsed, see
+    // Compiler::NonsenseCompiler
+    bool streaming = false;
+    // Write ELF64 object files rather than assembly
+    bool object = false;
+    // Write a perf map of the code run with Driver::run
+    bool perfMap = false;
+    // Where compiled functions are kept between runs, if anywhere
+    Cache::Cache *cache = nullptr;
+  };
+
+  // Compiles one file, writing the assembly or the object file to fd and
+  // any diagnostics to diagnostics. Returns false if the file has errors.
+  bool compile(const std::string &fileName, ThreadPool &pool, const Options &options,
+               int fd, std::ostream &diagnostics);
+
+  // Compiles one file to memory and runs its _start, or else its main.
+  // Returns the exit status: that of main, 0 for _start, 1 on errors.
+  int run(const std::string &fileName, ThreadPool &pool, const Options &options, std::ostream &diagnostics);
+
+  // The input name with its extension replaced by ".asm", or ".o" when
+  // compiling to object files
+  std::string outputName(const std::string &fileName, const Options &options);
+
+  // Appends the whitespace-separated file names listed in a response file
+  bool readResponseFile(const std::string &fileName, std::vector<std::string> &files);
+
+  // Compiles every file on the pool into its own output file. Diagnostics
+  // are buffered per file and printed in input order, so they never
+  // interleave. Returns false if any file has errors.
+  bool compileBatch(const std::vector<std::string> &files, ThreadPool &pool, const Options &options,
+                    std::ostream &diagnostics);
+
+  // A command line
+  class Command {
+  public:
+    Options options;
+    std::vector<std::string> files;
+    bool batch = false;
+    bool run = false;
+    // One per core if not given
+    size_t threads = 0;
+    std::string cacheDirectory;
+    // The socket to serve compilations on, see Server::serve
+    std::string server;
+  };
+
+  // Reads a command line, the program name first. Relative file names are
+  // taken relative to directory if it isn't empty. Returns false after
+  // printing why the command is wrong.
+  bool parseCommand(const std::vector<std::string> &args, const std::string &directory,
+                    Command &command, std::ostream &diagnostics);
+
+  // Does what the command asks, writing the output of a single file to out.
+  // Returns the exit status.
+  int execute(const Command &command, ThreadPool &pool, int out, std::ostream &diagnostics);
+}
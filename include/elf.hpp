@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mir.hpp"
+#include "output_buffer.hpp"
+
+// x86-64 ELF relocatable object files, as written by nasm -felf64
+namespace ELF {
+  enum class Section : uint8_t {
+    Undefined,
+    Text,
+    Data,
+    Bss
+  };
+
+  class Symbol {
+  public:
+    std::string name;
+    Section section;
+    uint64_t value;
+    bool global;
+  };
+
+  class Relocation {
+  public:
+    Section section;
+    uint64_t offset;
+    MIR::RelocationType type;
+    size_t symbol;
+    int64_t addend;
+  };
+
+  class ObjectFile {
+  public:
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> data;
+    uint64_t bssSize = 0;
+    std::vector<Symbol> symbols;
+    std::vector<Relocation> relocations;
+
+    // Returns the index of the symbol, as used by relocations
+    size_t addSymbol(std::string name, Section section, uint64_t value, bool global);
+    void addRelocation(Section section, uint64_t offset, MIR::RelocationType type, size_t symbol, int64_t addend);
+
+    // Relocations against local symbols are made against their section,
+    // like assemblers do
+    void write(OutputBuffer &out) const;
+  };
+}
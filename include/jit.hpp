@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "elf.hpp"
+
+// Runs an object file in this process. Its sections are laid out in memory
+// below 2 GB, where the 32-bit absolute addresses of the code reach them;
+// undefined symbols are looked up in the process with dlsym.
+namespace JIT {
+  class Error {
+  public:
+    std::string error;
+
+    Error(std::string err);
+  };
+
+  class Image {
+  private:
+    class Function {
+    public:
+      std::string name;
+      uint8_t *address;
+      size_t size;
+    };
+
+    uint8_t *memory;
+    size_t mappingSize;
+    // Calls the function passed in rdi, saving rbx for the caller
+    uint8_t *entry;
+    std::vector<Function> functions;
+
+  public:
+    // The code is made executable and read-only once it is relocated
+    Image(const ELF::ObjectFile &object);
+    Image(const Image &) = delete;
+    Image &operator =(const Image &) = delete;
+    ~Image();
+
+    bool has(std::string_view name) const;
+    // Calls a function without arguments, returning rax
+    int64_t call(std::string_view name) const;
+    // Writes /tmp/perf-<pid>.map, so perf can name the functions
+    bool writePerfMap() const;
+  };
+}
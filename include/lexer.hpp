@@ -1,31 +1,79 @@
 #pragma once
 
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
 #include "codefile.hpp"
 #include "lexer_position.hpp"
 #include "lexer_token.hpp"
 
+class ThreadPool;
+class TaskGroup;
+
 namespace Lexer {
+  std::string decodeString(std::string_view literal);
+
+  class Error {
+  public:
+    size_t offset;
+    std::string error;
+
+    Error(size_t off, std::string err);
+  };
+
   class Lexer {
   private:
-    Position position;
+    // A slice of the file lexed ahead of time on the thread pool
+    struct Chunk {
+      size_t begin = 0, end = 0;
+      TokenList tokens;
+      size_t next = 0;
+      size_t stop = 0;
+      bool failed = false;
+      size_t errorOffset = 0;
+      std::string error;
+      std::unique_ptr<TaskGroup> task;
+    };
+
+    size_t offset;
     char currentChar;
-    const CodeFile::CodeFile codeFile;
+    const CodeFile::CodeFile &codeFile;
+    std::string_view data;
+    ThreadPool *pool;
+    std::deque<Chunk> chunks;
+    size_t scheduled;
 
-    char replaceEscapedChar(char ch);
-    size_t findLineEnd();
+    Lexer(const CodeFile::CodeFile &cfile, const size_t begin, const size_t end);
+
+    char charAt(size_t i) const;
     char nextChar();
+    void seek(size_t off);
+    void finishToken(Token &token);
     Token getNumberToken();
     Token getStringToken();
     Token getCharToken();
     Token getIdentifierToken();
     Token getOperatorToken();
-    
+    Token lexToken();
+    void scheduleChunk();
+    Token nextChunkToken();
+
   public:
-    TokenList tokenList;
+    // With a pool of several threads, large files are lexed in parallel
+    // slices a few at a time, ahead of the consumer. The file must not be
+    // too large for its offsets, which the driver checks.
+    Lexer(const CodeFile::CodeFile &cfile, ThreadPool *pool_ = nullptr);
+    Lexer(const Lexer &) = delete;
+    ~Lexer();
 
-    Lexer(const CodeFile::CodeFile &cfile);
+    Position getPosition(const size_t off);
+    void printError(const size_t off, const std::string &errMsg, const size_t underlineLen = 1);
+    void printError(std::ostream &out, const size_t off, const std::string &errMsg, const size_t underlineLen = 1);
 
-    void printError(const Position pos, const std::string &errMsg, const size_t underlineLen = 1);
-    TokenList tokenize(); 
+    // Returns the next token or, at the end of the input, an EndOfFile
+    // token; throws Error on malformed input
+    Token nextToken();
   };
 }
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace Lexer {
+  // Run scanners for the lexer's hot loops. Each one returns the offset of
+  // the first byte at or after `from` that ends the run (or data.size()).
+  // The implementation is picked once at startup: AVX2 or SSE2 when the
+  // CPU has them, a scalar loop otherwise.
+  size_t skipWhitespace(std::string_view data, size_t from);
+  size_t scanIdentifier(std::string_view data, size_t from);
+  size_t scanDigits(std::string_view data, size_t from);
+  size_t scanStringBody(std::string_view data, size_t from);
+}
@@ -1,20 +1,22 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
-#include "lexer_position.hpp"
+#include <string_view>
 
 namespace Lexer {
-  enum class Type {
+  enum class Type : uint8_t {
     Integer,
     Float,
     String,
     Identifier,
     Char,
     Operator,
+    EndOfFile
   };
 
-  enum class OperatorType {
+  enum class OperatorType : uint8_t {
     None,
     Plus,
     Minus,
@@ -50,16 +52,50 @@ namespace Lexer {
     Percent
   };
   
+  enum class Keyword : uint8_t {
+    None,
+    Var,
+    Fn,
+    If,
+    While,
+    For,
+    Def,
+    Extern,
+    Static,
+    As,
+    Else
+  };
+
+  // Tokens don't own their text: they refer to a span of the source buffer
+  // and carry the parsed value of numeric and char literals or, for
+  // identifiers, the keyword they spell. String literals and identifiers
+  // too long for length keep it in integer instead, which they don't use
+  // otherwise; such an identifier is never a keyword.
   class Token {
   public:
+    static constexpr uint16_t LONG_LENGTH = UINT16_MAX;
+
+    uint32_t offset;
+    // Read through size(), which knows about long tokens
+    uint16_t length;
     Type type;
     OperatorType operatorType;
-    std::string value;
-    Position position; 
+    union {
+      int64_t integer;
+      double real;
+    };
+
+    size_t size() const {
+      return length != LONG_LENGTH ? length : static_cast<size_t>(integer);
+    }
 
-    void printTokenJSON();
-    Token(const Type T, const std::string V, const Position pos);
+    std::string_view value(std::string_view source) const;
+    Keyword keyword() const;
+    void printTokenJSON(std::string_view source);
+    Token(const Type T, const size_t off);
   };
 
+  static_assert(sizeof(Token) == 16, "Token must stay compact");
+
   typedef std::vector<Token> TokenList; 
 }
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lexer_token.hpp"
+#include "output_buffer.hpp"
+
+// Machine IR: the x86-64 instructions of a function as records, kept in
+// basic blocks until they are printed as NASM
+namespace MIR {
+  enum class Reg : uint8_t {
+    None,
+    RAX, RBX, RCX, RDX, RSI, RDI, RBP, RSP, R8, R9, R10,
+    EAX, EBX, ECX, EDX,
+    AL, BL
+  };
+
+  enum class Size : uint8_t {
+    None,
+    Byte,
+    Word,
+    Dword,
+    Qword
+  };
+
+  enum class Opcode : uint8_t {
+    Nop,
+    Label,
+    Raw,
+    Mov,
+    Movzx,
+    Add,
+    Sub,
+    Imul,
+    Mul,
+    Idiv,
+    Cmp,
+    And,
+    Or,
+    Sete,
+    Setne,
+    Setg,
+    Setl,
+    Setge,
+    Setle,
+    Push,
+    Pop,
+    Dec,
+    Call,
+    Jmp,
+    Je,
+    Jle,
+    Ret
+  };
+
+  // The kinds of local labels, printed as .<kind>_<id>
+  enum class LabelKind : uint8_t {
+    EndIf,
+    EndElse,
+    BeginWhile,
+    EndWhile,
+    BeginFor,
+    EndFor,
+    Pow,
+    EndPow
+  };
+
+  // Names are kept as spans of the source rather than strings
+  class Operand {
+  public:
+    enum class Kind : uint8_t {
+      None,
+      Reg,
+      Imm,
+      Mem,
+      Symbol,
+      Label,
+      StringLiteral,
+      Text
+    };
+
+    Kind kind;
+    // Reg: the register; Mem: the base
+    Reg reg;
+    Reg index;
+    uint8_t scale;
+    Size size;
+    // Imm: printed in hex; Label: its LabelKind
+    uint8_t flags;
+    // Length of the source span of Symbol, Text and Mem without a base
+    uint32_t length;
+    // Imm: the value; Mem: the displacement or the source offset of the
+    // symbol; Symbol, Text: the source offset; Label: the id;
+    // StringLiteral: its number in the function
+    int64_t value;
+
+    Operand()
+      : kind(Kind::None), reg(Reg::None), index(Reg::None), scale(1), size(Size::None), flags(0), length(0), value(0) {}
+  };
+
+  Operand reg(Reg r);
+  Operand imm(int64_t value);
+  Operand hex(int64_t value);
+  Operand mem(Size size, Reg base, int64_t disp = 0, Reg index = Reg::None, uint8_t scale = 1);
+  Operand mem(Size size, const Lexer::Token &symbol);
+  Operand symbol(const Lexer::Token &name);
+  Operand text(const Lexer::Token &tok);
+  Operand label(LabelKind kind, int64_t id);
+  Operand stringLiteral(size_t number);
+
+  std::string_view regName(Reg r);
+  std::string_view sizeName(Size size);
+
+  class Instruction {
+  public:
+    Opcode opcode;
+    Operand operands[2];
+  };
+
+  // A run of instructions entered only at the top: a new block starts at
+  // every label, after every jump or return and once a block holds
+  // MAX_BLOCK_SIZE instructions, falling through into the next
+  class Block {
+  public:
+    std::vector<Instruction> instructions;
+  };
+
+  constexpr size_t MAX_BLOCK_SIZE = 4096;
+
+  class Code {
+  public:
+    class Position {
+    public:
+      size_t block;
+      size_t index;
+    };
+
+  private:
+    std::vector<Block> blocks;
+    std::vector<std::string> rawText;
+    bool blockEnded;
+    size_t pendingInstructions;
+
+    void startBlock();
+
+  public:
+    Code();
+
+    Position emit(Opcode opcode, const Operand &first = Operand(), const Operand &second = Operand()) {
+      if(blockEnded || blocks.back().instructions.size() >= MAX_BLOCK_SIZE)
+        startBlock();
+
+      auto &instructions = blocks.back().instructions;
+      instructions.push_back({ opcode, { first, second } });
+      ++pendingInstructions;
+
+      if(opcode == Opcode::Jmp || opcode == Opcode::Je || opcode == Opcode::Jle || opcode == Opcode::Ret)
+        blockEnded = true;
+
+      return { blocks.size() - 1, instructions.size() - 1 };
+    }
+
+    void label(Operand name);
+    // Inline assembly, kept as written
+    void raw(std::string text);
+    Instruction &at(Position position);
+
+    const std::vector<Block> &getBlocks() const;
+    // Blocks that nothing more is emitted into
+    size_t finishedBlocks() const;
+    // Instructions emitted since the last release
+    size_t pending() const;
+    // Frees the instructions of blocks [first, last) once they are printed
+    void release(size_t first, size_t last);
+    const std::string &getRawText(size_t index) const;
+    bool empty() const;
+    void clear();
+  };
+
+  // Prints the code as NASM. String literals are named after the function
+  // scope, or after nothing for the global scope.
+  void print(const Code &code, std::string_view source, std::string_view scope, OutputBuffer &out);
+  // Prints blocks [first, last) only
+  void print(const Code &code, size_t first, size_t last,
+             std::string_view source, std::string_view scope, OutputBuffer &out);
+
+  // An instruction that has no x86-64 encoding
+  class EncodeError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  enum class RelocationType : uint8_t {
+    // The 64-bit address of the target
+    Abs64,
+    // Its address as a zero-extended 32-bit value
+    Abs32,
+    // Its address as a sign-extended 32-bit displacement
+    Abs32S,
+    // Its address relative to the end of the 32-bit field
+    Pc32
+  };
+
+  // A field of the code that holds the address of a Symbol or
+  // StringLiteral operand, plus the addend
+  class Relocation {
+  public:
+    size_t offset;
+    RelocationType type;
+    Operand target;
+    int64_t addend;
+  };
+
+  // The x86-64 machine code of a function. Blocks are encoded as they are
+  // finished; once all are, finish() lays them out, choosing the shortest
+  // form of every jump like NASM does.
+  class MachineCode {
+  private:
+    struct EncodedBlock {
+      // The encoding of the block without its closing jump, in scratch
+      size_t begin = 0, end = 0;
+      // Its relocations in scratchRelocations, with offsets from begin
+      size_t firstRelocation = 0, lastRelocation = 0;
+      // The label the block starts at, if any
+      Operand label;
+      // Jmp, Je or Jle, or Nop for none
+      Opcode jump = Opcode::Nop;
+      Operand target;
+    };
+
+    std::vector<EncodedBlock> blocks;
+    std::vector<uint8_t> scratch;
+    std::vector<Relocation> scratchRelocations;
+
+  public:
+    std::vector<uint8_t> bytes;
+    std::vector<Relocation> relocations;
+
+    // Encodes blocks [first, last) of code, which may then be released
+    void encode(const Code &code, size_t first, size_t last, std::string_view source);
+    void finish();
+  };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Append-only text kept in chunks that never move once written, so
+// appending never copies what is already there and whole buffers are
+// joined by handing their chunks over. Written out with writev.
+class OutputBuffer {
+private:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  std::vector<Chunk> chunks;
+  char *cursor;
+  char *limit;
+  size_t nextChunkSize;
+  size_t total;
+
+  void grow(size_t minSize);
+  void append(const char *text, size_t length);
+
+public:
+  OutputBuffer();
+  OutputBuffer(OutputBuffer &&other) noexcept;
+  OutputBuffer &operator =(OutputBuffer &&other) noexcept;
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator =(const OutputBuffer &) = delete;
+
+  OutputBuffer &operator <<(std::string_view text) {
+    if(static_cast<size_t>(limit - cursor) >= text.size()) {
+      std::memcpy(cursor, text.data(), text.size());
+      cursor += text.size();
+      total += text.size();
+    } else {
+      append(text.data(), text.size());
+    }
+
+    return *this;
+  }
+
+  OutputBuffer &operator <<(char ch) {
+    return *this << std::string_view(&ch, 1);
+  }
+
+  template<typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>>>
+  OutputBuffer &operator <<(T number) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
+
+    return *this << std::string_view(digits, static_cast<size_t>(result.ptr - digits));
+  }
+
+  // Takes over the chunks of other, leaving it empty
+  OutputBuffer &operator <<(OutputBuffer &&other);
+
+  size_t size() const;
+  bool empty() const;
+  void clear();
+  void appendTo(std::string &text) const;
+
+  // Writes everything to fd and clears the buffer
+  bool writeTo(int fd);
+};
@@ -1,60 +1,87 @@
 #pragma once
 
 #include "lexer_token.hpp"
+#include "token_stream.hpp"
 #include "AST.hpp"
-#include <functional>
-#include <stack>
+#include "arena.hpp"
+#include <cstdint>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 namespace Parser {
   class Error {
   public:
-    Lexer::Token &token;
+    size_t offset;
     std::string error;
 
-    Error(Lexer::Token &tok, std::string err);
+    Error(const Lexer::Token &tok, std::string err);
+    Error(size_t off, std::string err);
   };
 
   class Parser {
   private:
-    Lexer::TokenList &tokens;
-    Lexer::TokenList::iterator current;
+    Lexer::TokenStream &tokens;
+    size_t current;
+    std::string_view source;
+    std::vector<AST::NodeId> pending;
 
     void match(std::string l);
-    Lexer::Token &match(Lexer::Type t);
-    Lexer::Token &match(Lexer::OperatorType ot);
+    Lexer::Token match(Lexer::Type t);
+    Lexer::Token match(Lexer::OperatorType ot);
     void next();
-    void clearOperatorsStack(std::stack<Lexer::Token*> &ops, std::stack<AST::Node*> &opds,
-                             std::function<bool()> expr = []() -> bool { return true; });
-    AST::Node *parseList(std::function<AST::Node*()> parseElement);
+    const Lexer::Token &peek();
+    Lexer::Token at(size_t index);
+    AST::NodeId parseBinary(AST::NodeId left, uint8_t minPrecedence);
+    template<typename ParseElement>
+    AST::NodeId parseList(ParseElement parseElement);
+    AST::NodeList collect(size_t base);
+    AST::Type getType(const std::pair<AST::NodeList, Lexer::Token> &type);
+
+    template<typename Node, typename... Args>
+    AST::NodeId make(Args&&... args) {
+      AST::NodeId node = tree.add(Node(std::forward<Args>(args)...));
+
+      if(!node)
+        throw Error(at(current), "Too many nodes");
+
+      return node;
+    }
     
   public:
-    AST::StatementsNode stmts;
-    Parser(Lexer::TokenList &toks);
-
-    AST::StatementsNode     *parseStatements();
-    AST::Node               *parseStatement();
-    AST::FunctionNode       *parseFunction();
-    AST::VariableNode       *parseVariableDeclaration();
-    AST::ValueNode          *parseValue();
-    AST::ValueNode          *parseVariable();
-    AST::UnaryNode          *parseCall();
-    AST::Node               *parseFormula();
-    AST::VariableNode       *parseParameter();
-    AST::ParametersNode     *parseParameters();
-    AST::Node               *parseParenthesisFormula();
-    AST::ParametersNode     *parseArguments();
-    AST::Node               *parseOperand();
-    AST::UnaryNode          *parseUnaryOperator();
-    AST::BinaryNode         *parseIndex();
-    AST::BinaryNode         *parseIndexes(AST::Node *left);
-    AST::IfStatementNode    *parseIfStatement();
-    AST::CycleStatementNode *parseWhileStatement();
-    AST::CycleStatementNode *parseForStatement();
-    AST::Node               *parseReturn();
-    AST::Node               *parseTypeModifier();
-    std::vector<AST::Node*> parseTypeModifiers();
-    std::pair<std::vector<AST::Node*>, Lexer::Token&> parseType();
+    AST::Tree tree;
+    AST::NodeList stmts;
+    // Parses the whole file into stmts unless parseAll is false; then
+    // declarations are taken one at a time with parseDeclaration()
+    Parser(Lexer::TokenStream &toks, std::string_view source_, bool parseAll = true);
+
+    // The next top-level declaration, or the null node at the end of the file
+    AST::NodeId parseDeclaration();
+
+    // Each returns the null node when what it parses isn't there
+    AST::NodeId parseStatements();
+    AST::NodeId parseStatement();
+    AST::NodeId parseFunction();
+    AST::NodeId parseVariableDeclaration();
+    AST::NodeId parseValue();
+    AST::NodeId parseVariable();
+    AST::NodeId parseCall();
+    AST::NodeId parseFormula();
+    AST::NodeId parseParameter();
+    AST::NodeId parseParameters();
+    AST::NodeId parseParenthesisFormula();
+    AST::NodeId parseArguments();
+    AST::NodeId parseOperand();
+    AST::NodeId parseUnaryOperator();
+    AST::NodeId parseIndex();
+    AST::NodeId parseIndexes(AST::NodeId left);
+    AST::NodeId parseIfStatement();
+    AST::NodeId parseWhileStatement();
+    AST::NodeId parseForStatement();
+    AST::NodeId parseReturn();
+    AST::NodeId parseTypeModifier();
+    AST::NodeList parseTypeModifiers();
+    std::pair<AST::NodeList, Lexer::Token> parseType();
   };
 
 }
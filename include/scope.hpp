@@ -2,29 +2,47 @@
 
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "AST.hpp"
 #include "variable.hpp"
+#include "output_buffer.hpp"
+#include "mir.hpp"
 
 class Scope {
 public:
-  std::unordered_map<std::string, Variable> variables;
-  std::string text;
-  virtual Variable &addVariable(AST::VariableNode *node_, AssemblerType asmtype);
+  std::unordered_map<std::string_view, Variable> variables;
+  MIR::Code code;
+  // The code printed as NASM
+  OutputBuffer text;
+  std::vector<std::string> stringLiterals;
+  // Local labels made so far, which number them
+  int64_t labelCount = 0;
+  virtual Variable &addVariable(std::string_view name, const AST::Tree &tree, AST::VariableNode *node_,
+                                const AssemblerType &asmtype);
 };
 
 class Function : public Scope {
 public:
+  // The tree the node is in
+  AST::Tree *tree;
   AST::FunctionNode *node;
   size_t variablesOffset;
+  // The code encoded, when compiling to an object file
+  MIR::MachineCode machineCode;
+  // Blocks of code already printed to text or encoded; the first block
+  // holds the frame setup and is done last, in front of the others
+  size_t printedBlocks;
   
-  Variable &addVariable(AST::VariableNode *node_, AssemblerType asmtype) override;
+  Variable &addVariable(std::string_view name, const AST::Tree &tree_, AST::VariableNode *node_,
+                        const AssemblerType &asmtype) override;
   
-  Function(AST::FunctionNode *node_);
+  Function(AST::Tree &tree_, AST::FunctionNode *node_);
 };
 
 class GlobalScope : public Scope {
 public:
-  std::unordered_map<std::string, Function> functions;
-  Variable &addVariable(AST::VariableNode *node_, AssemblerType asmtype) override;
-  std::vector<std::string> stringLiterals;
+  std::unordered_map<std::string_view, Function> functions;
+  Variable &addVariable(std::string_view name, const AST::Tree &tree, AST::VariableNode *node_,
+                        const AssemblerType &asmtype) override;
 };
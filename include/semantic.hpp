@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string_view>
+#include "AST.hpp"
+#include "scope.hpp"
+#include "variable.hpp"
+
+// The checks of a function body, made before any of its code. The body is
+// walked in the order its code is made: names are bound and locals are
+// declared as they are met, every expression gets its type once and every
+// error is thrown where emission would have met it, so the first error of
+// a file is the same either way. Emission then only reads the nodes.
+namespace Semantic {
+  class Analyzer {
+  private:
+    std::string_view source;
+    GlobalScope &global;
+    Function &func;
+    // The tree the function was parsed into
+    AST::Tree &tree;
+    // Inline assembly only goes into assembly output
+    bool inlineAssembly;
+
+    std::string_view value(const Lexer::Token &tok);
+    Variable &bindVariable(AST::ValueNode &val);
+    AST::Type valueType(AST::ValueNode &val);
+    bool compareOperandsTypes(const AST::Type &first, const AST::Type &second);
+    void analyzeStatements(AST::NodeId stmts);
+    void analyzeStatement(AST::NodeId stmt);
+    void analyzeBody(AST::NodeId body);
+    void analyzeVariableDeclaration(AST::VariableNode &varNode);
+    void analyzeAsmIncluding(AST::NodeId strings);
+    void analyzeIfStatement(AST::NodeId ifstat);
+    void analyzeCycleStatement(AST::NodeId cycle);
+    void analyzeFormula(AST::NodeId node);
+    void analyzeValue(AST::ValueNode &val);
+    void analyzeVariableAddress(AST::ValueNode &varNode);
+    void analyzeBinary(AST::BinaryNode &bin);
+    void analyzeIndex(AST::BinaryNode &bin);
+    void analyzeAssign(AST::BinaryNode &bin);
+    void analyzeAssignLeftOperand(AST::NodeId opd);
+    void analyzeUnary(AST::UnaryNode &unr);
+    void analyzeCall(AST::UnaryNode &fnNode);
+
+  public:
+    Analyzer(std::string_view source_, GlobalScope &global_, Function &func_, bool inlineAssembly_);
+
+    // The parameters of the function must be declared already
+    void analyze();
+  };
+}
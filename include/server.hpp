@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+namespace Cache {
+  class Cache;
+}
+
+// A compiler that stays running and takes command lines over a Unix
+// socket, so a compile pays no start-up and finds the functions it
+// compiled before in memory. The client passes its stdout and stderr
+// along with the request, and the server writes to them directly.
+namespace Server {
+  // Serves requests until killed, each on the pool
+  int serve(const std::string &socketPath, ThreadPool &pool, Cache::Cache &cache);
+
+  // Sends a command line to the server and returns its exit status
+  int request(const std::string &socketPath, const std::vector<std::string> &args);
+}
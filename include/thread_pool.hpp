@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "time_report.hpp"
+
+class TaskGroup;
+
+class ThreadPool {
+private:
+  struct Task {
+    std::function<void()> run;
+    // The group the task belongs to, if any
+    TaskGroup *group;
+    // What the pushing thread was charged to
+    TimeReport::Usage *usage;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // Every worker owns a queue; queue 0 belongs to the threads outside the
+  // pool. Tasks are pushed to the pushing thread's own queue, and a thread
+  // out of work steals from the others.
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> queued;
+  std::mutex sleepMutex;
+  std::condition_variable available;
+  bool stopping;
+
+  size_t ownQueue() const;
+  bool take(size_t own, const TaskGroup *group, Task &task);
+  static void run(Task &task);
+  void work(size_t index);
+
+  friend class TaskGroup;
+  void push(std::function<void()> task, TaskGroup *group);
+  bool runPending(const TaskGroup &group);
+
+public:
+  // The thread that waits on a TaskGroup runs its tasks too, so a pool of
+  // size N starts N - 1 workers and a pool of size 1 runs everything inline
+  ThreadPool(size_t threads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator =(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  size_t size() const;
+  void push(std::function<void()> task);
+};
+
+// A batch of tasks that can be waited on. Waiting runs the tasks of the
+// group that haven't started yet, never those of others, so groups may be
+// nested inside tasks of other groups; once all of them have started the
+// waiter sleeps until they are done.
+class TaskGroup {
+private:
+  ThreadPool &pool;
+  // Tasks not finished, and tasks not started yet
+  std::atomic<size_t> pending;
+  std::atomic<size_t> queued;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::exception_ptr error;
+
+  friend class ThreadPool;
+  void finishTask();
+  void waitTasks();
+
+public:
+  TaskGroup(ThreadPool &pool_);
+  ~TaskGroup();
+
+  void run(std::function<void()> task);
+  void wait();
+};
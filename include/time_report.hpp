@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "allocations.hpp"
+
+// Where the time and the memory of a compile go, phase by phase, as
+// --time-report prints it. CPU time and allocations are those of the
+// thread that compiles the file and of the tasks it pushes to the pool, so
+// files compiled at the same time don't count each other's. Peak RSS can
+// only be had for the whole process.
+namespace TimeReport {
+  // What the tasks of a compile used on the threads that ran them
+  class Usage {
+  public:
+    std::atomic<int64_t> cpu{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> allocatedBytes{0};
+  };
+
+  // The usage the tasks pushed by the calling thread are charged to, if any
+  Usage *chargedUsage();
+
+  // Charges what the calling thread does while it lives to usage. A thread
+  // already charged to usage, as that of its report is, counts it itself.
+  class Charge {
+  private:
+    Usage *usage;
+    Usage *previous;
+    std::chrono::nanoseconds cpuStart;
+    Allocations::Counts allocationsStart;
+
+  public:
+    explicit Charge(Usage *usage_);
+    Charge(const Charge &) = delete;
+    Charge &operator =(const Charge &) = delete;
+    ~Charge();
+  };
+
+  class Phase {
+  public:
+    std::string name;
+    std::chrono::nanoseconds wall;
+    std::chrono::nanoseconds cpu;
+    Allocations::Counts allocations;
+  };
+
+  class Report {
+  private:
+    std::chrono::steady_clock::time_point wallStart;
+    std::chrono::nanoseconds cpuStart;
+    Allocations::Counts allocationsStart;
+    Usage usage;
+    Usage *previous;
+
+    std::chrono::nanoseconds cpuTime() const;
+    Allocations::Counts allocations() const;
+    void start();
+
+  public:
+    std::vector<Phase> phases;
+    // Summed over the threads, see Compiler::NonsenseCompiler
+    std::chrono::nanoseconds analysis{0};
+    size_t sourceBytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    size_t functions = 0;
+    size_t outputBytes = 0;
+
+    // The first phase begins here, every next one where the last ended.
+    // Tasks pushed by the thread are charged to the report while it lives.
+    Report();
+    Report(const Report &) = delete;
+    Report &operator =(const Report &) = delete;
+    ~Report();
+    void endPhase(std::string name);
+
+    // A table, or a line of JSON
+    void print(std::ostream &out, const std::string &fileName, bool json) const;
+  };
+
+  // The peak RSS of the process so far, as a line of text or of JSON
+  void printPeakRss(std::ostream &out, bool json);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "lexer.hpp"
+#include "lexer_token.hpp"
+
+namespace Lexer {
+  // Tokens pulled from the lexer on demand. Consumers address them by
+  // absolute index; only the window between the last released index and
+  // the furthest lookahead is kept, in a ring buffer that grows when the
+  // lookahead does.
+  class TokenStream {
+  private:
+    Lexer &lexer;
+    std::vector<Token> ring;
+    size_t first;
+    size_t last;
+    bool ended;
+
+    void grow();
+    void fill(size_t index);
+
+  public:
+    TokenStream(Lexer &lexer_);
+
+    // Past the end of the input every index yields the EndOfFile token.
+    // The reference is only valid until the next call to at().
+    const Token &at(size_t index);
+
+    // Drops the tokens before index; they can't be looked at anymore
+    void release(size_t index);
+
+    // The tokens taken from the lexer so far, EndOfFile included
+    size_t count() const;
+  };
+}
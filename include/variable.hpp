@@ -12,14 +12,14 @@ class Variable {
 public:
   AST::VariableNode *node;
   std::string initializer;
-  AssemblerType asmtype;
+  const AssemblerType *asmtype;
   size_t stackOffset;
-
-  std::vector<size_t> dimensionsSize;
   size_t arraySizeInBytes;
+  // On the stack of a function rather than in the data sections
+  bool isLocal;
 
   VariableType variableType;
 
-  Variable(VariableType vtype, AST::VariableNode *node_, size_t stoffset, AssemblerType atype);
-  Variable(AST::VariableNode *node_, size_t stoffset, AssemblerType atype);
+  // Reads the modifiers of the node from the tree it is in
+  Variable(const AST::Tree &tree, AST::VariableNode *node_, size_t stoffset, const AssemblerType &atype);
 };
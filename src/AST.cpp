@@ -1,166 +1,234 @@
 #include "AST.hpp"
-#include <vector>
-#include <iostream>
+#include <algorithm>
+#include <utility>
 
 using namespace std;
 
 namespace AST {
-  // Node
-  Node::Node(const NodeType T, Lexer::Token &beg) : type(T), begin(beg) {}
-  Node::~Node() {}
-  void Node::printJSON(string spaces) { (void)spaces; }
-
   // Statementsnode
-  StatementsNode::StatementsNode(Lexer::Token &beg)
-    : Node(NodeType::Statements, beg) {}
+  StatementsNode::StatementsNode(const Lexer::Token &beg, NodeList stmts) : begin(beg.offset), statements(stmts) {}
+
+  TypeId typeByName(std::string_view name) {
+    static const std::pair<std::string_view, TypeId> NAMES[] = {
+      { "i64", TypeId::I64 },
+      { "i32", TypeId::I32 },
+      { "byte", TypeId::Byte },
+      { "void", TypeId::Void }
+    };
+
+    for(auto &[typeName, id] : NAMES)
+      if(typeName == name)
+        return id;
 
-  StatementsNode::~StatementsNode() {
-    for(auto n : statements)
-      delete n;
+    return TypeId::Unknown;
   }
-  
-  void StatementsNode::addNode(Node *node) {
-    statements.push_back(node);
+
+  Type::Type() : base(TypeId::None), isPointer(false), pointerLevel(0) {}
+  Type::Type(TypeId base_, size_t ptrlvl, bool isPtr) : base(base_), isPointer(isPtr), pointerLevel(static_cast<uint16_t>(ptrlvl)) {}
+
+  bool Type::operator ==(const Type &t) const {
+    return base == t.base && pointerLevel == t.pointerLevel;
   }
 
-  Type::Type() : type(""), pointerLevel(0), isPointer(false) {}
-  Type::Type(std::string type_, size_t ptrlvl, bool isPtr) : type(type_), pointerLevel(ptrlvl), isPointer(isPtr) {}
-  
-  bool Type::operator ==(const Type &t) {
-    return type == t.type && pointerLevel == t.pointerLevel;
+  bool Type::operator !=(const Type &t) const {
+    return base != t.base || pointerLevel != t.pointerLevel;
   }
 
-  bool Type::operator !=(const Type &t) {
-    return type != t.type || pointerLevel != t.pointerLevel;
+  bool Type::isNull() const {
+    return base == TypeId::None;
   }
 
-  bool Type::isNull() {
-    return type == "";
+  OperatorToken::OperatorToken(const Lexer::Token &tok)
+    : offset(tok.offset), length(tok.length), operatorType(tok.operatorType) {}
+
+  std::string_view OperatorToken::value(std::string_view source) const {
+    return source.substr(offset, length);
   }
-  
+
   // VariableNode
-  VariableNode::VariableNode(Lexer::Token &T, vector<Node*> &mods, Lexer::Token &var,
-                             Node *val, bool isext, Lexer::Token &beg)
-    : Node(NodeType::Variable, beg),
+  VariableNode::VariableNode(const Lexer::Token &T, const Type &exprType_, NodeList mods, const Lexer::Token &var,
+                             NodeId val, bool isext, const Lexer::Token &beg)
+    : begin(beg.offset),
+      exprType(exprType_),
       varTypeToken(T),
       name(var),
       modifiers(mods),
       body(val),
       isExtern(isext),
-      isDefined(val != nullptr)
-  {
-    exprType = Type(T.value, mods.size(), mods.size() != 0);
-  }
+      isDefined(static_cast<bool>(val)),
+      variable(nullptr) {}
 
-  VariableNode::~VariableNode() {
-    if(body != nullptr)
-      delete body;
+  // ValueNode
+  ValueNode::ValueNode(const Lexer::Token &val) : value(val), variable(nullptr) {}
 
-    for(auto i : modifiers) {
-      if(i != nullptr)
-        delete i;
-    }
+  // BinaryNode
+  BinaryNode::BinaryNode(const Lexer::Token &op_, NodeId left_, NodeId right_) : op(op_), left(left_), right(right_) {}
 
-    modifiers.clear();
-    body = nullptr;
-  }
+  // UnaryNode
+  UnaryNode::UnaryNode(const Lexer::Token &op_, NodeId node_) : op(op_), node(node_) {}
 
-  // ValueNode
-  ValueNode::ValueNode(Lexer::Token &val, Lexer::Token &beg)
-    : Node(NodeType::Value, beg), value(val) {}
+  // FunctionNode
+  FunctionNode::FunctionNode(const Lexer::Token &T, const Type &exprType_, NodeList mods, const Lexer::Token &name_,
+                             NodeId parameters_, NodeId body_, bool isext, const Lexer::Token &beg)
+    : VariableNode(T, exprType_, mods, name_, body_, isext, beg),
+      parameters(parameters_) {}
 
-  // BinaryNode
-  BinaryNode::BinaryNode(Lexer::Token &op_, Node *left_, Node *right_, Lexer::Token &beg)
-    : Node(NodeType::BinaryOperator, beg),
-      op(op_), left(left_), right(right_) {}
+  // ParameterNode
+  ParametersNode::ParametersNode(const Lexer::Token &beg, NodeList params) : begin(beg.offset), parameters(params) {}
 
-  BinaryNode::~BinaryNode() {
-    if(left != nullptr)
-      delete left;
-    
-    if(right != nullptr)
-      delete right;
+  IfStatementNode::IfStatementNode(NodeId cond, NodeId ifstat, NodeId elsestat, const Lexer::Token &beg)
+    : begin(beg.offset), condition(cond), ifstatement(ifstat), elsestatement(elsestat) {}
 
-    left = nullptr;
-    right = nullptr;
-  };
+  CycleStatementNode::CycleStatementNode(NodeId cond, NodeId stat, const Lexer::Token &beg)
+    : begin(beg.offset), condition(cond), statement(stat) {}
 
-  // UnaryNode
-  UnaryNode::UnaryNode(Lexer::Token &op_, Node *node_, Lexer::Token &beg)
-    : Node(NodeType::UnaryOperator, beg), op(op_), node(node_) {}
+  NodeList Tree::list(const NodeId *items, size_t count) {
+    NodeId *copy = static_cast<NodeId*>(arena.allocate(count * sizeof(NodeId), alignof(NodeId)));
 
-  UnaryNode::~UnaryNode() {
-    if(node != nullptr)
-      delete node;
+    std::copy(items, items + count, copy);
 
-    node = nullptr;
+    return NodeList(copy, count);
   }
 
-  // FunctionNode
-  FunctionNode::FunctionNode(Lexer::Token &T, vector<Node*> mods, Lexer::Token &name_,
-                             ParametersNode *parameters_, Node *body_, bool isext, Lexer::Token &beg)
-    : VariableNode(T, mods, name_, body_, isext, beg),
-      parameters(parameters_) {
-    type = NodeType::Function;
+  uint32_t Tree::begin(NodeId node) const {
+    switch(node.type()) {
+    case NodeType::Statements:
+      return statements(node).begin;
+    case NodeType::Variable:
+      return variable(node).begin;
+    case NodeType::Value:
+      return value(node).value.offset;
+    case NodeType::BinaryOperator:
+      return binary(node).op.offset;
+    case NodeType::UnaryOperator:
+      return unary(node).op.offset;
+    case NodeType::Function:
+      return function(node).begin;
+    case NodeType::Parameters:
+      return parameters(node).begin;
+    case NodeType::IfStatement:
+      return ifStatement(node).begin;
+    default:
+      return cycleStatement(node).begin;
+    }
   }
 
-  FunctionNode::~FunctionNode() {
-    if(parameters != nullptr)
-      delete parameters;
-
-    if(body != nullptr)
-      delete body;
-
-    for(auto i : modifiers) {
-      delete i;
+  // Lists and statements have no type, and aren't asked for one
+  Type &Tree::exprType(NodeId node) {
+    switch(node.type()) {
+    case NodeType::Value:
+      return value(node).exprType;
+    case NodeType::BinaryOperator:
+      return binary(node).exprType;
+    case NodeType::UnaryOperator:
+      return unary(node).exprType;
+    case NodeType::Function:
+      return function(node).exprType;
+    default:
+      return variable(node).exprType;
     }
+  }
 
-    modifiers.clear();
-    parameters = nullptr;
-    body = nullptr;
+  void Tree::reset() {
+    statementsNodes.clear();
+    variableNodes.clear();
+    valueNodes.clear();
+    binaryNodes.clear();
+    unaryNodes.clear();
+    functionNodes.clear();
+    parametersNodes.clear();
+    ifStatementNodes.clear();
+    cycleStatementNodes.clear();
+    arena.reset();
   }
 
-  // ParameterNode
-  void ParametersNode::addParameter(Node *parameter) {
-    parameters.push_back(parameter);
+  size_t Tree::nodeCount() const {
+    return nodesMade;
   }
-  
-  ParametersNode::ParametersNode(Lexer::Token &beg) : Node(NodeType::Parameters, beg) {}
 
-  ParametersNode::~ParametersNode() {
-    for(auto i : parameters)
-      delete i;
+  NodeList Tree::cloneList(const Tree &from, NodeList list) {
+    NodeId *items = static_cast<NodeId*>(arena.allocate(list.size() * sizeof(NodeId), alignof(NodeId)));
+
+    for(size_t i = 0; i < list.size(); ++i)
+      items[i] = clone(from, list[i]);
+
+    return NodeList(items, list.size());
   }
- 
-  IfStatementNode::IfStatementNode(Node *cond, Node *ifstat, Node *elsestat, Lexer::Token &beg)
-    : Node(NodeType::IfStatement, beg), condition(cond), ifstatement(ifstat), elsestatement(elsestat) {}
-
-  IfStatementNode::~IfStatementNode() {
-    if(condition != nullptr)
-      delete condition;
-    
-    if(ifstatement != nullptr)
-      delete ifstatement;
-
-    if(elsestatement != nullptr)
-      delete elsestatement;
-
-    condition = nullptr;
-    ifstatement = nullptr;
-    elsestatement = nullptr;
+
+  NodeId Tree::clone(const Tree &from, NodeId node) {
+    if(!node)
+      return node;
+
+    switch(node.type()) {
+    case NodeType::Statements: {
+      StatementsNode copy = from.statements(node);
+      copy.statements = cloneList(from, copy.statements);
+      return add(copy);
+    }
+
+    case NodeType::Variable: {
+      VariableNode copy = from.variable(node);
+      copy.modifiers = cloneList(from, copy.modifiers);
+      copy.body = clone(from, copy.body);
+      return add(copy);
+    }
+
+    case NodeType::Value:
+      return add(from.value(node));
+
+    case NodeType::BinaryOperator: {
+      BinaryNode copy = from.binary(node);
+      copy.left = clone(from, copy.left);
+      copy.right = clone(from, copy.right);
+      return add(copy);
+    }
+
+    case NodeType::UnaryOperator: {
+      UnaryNode copy = from.unary(node);
+      copy.node = clone(from, copy.node);
+      return add(copy);
+    }
+
+    case NodeType::Function: {
+      FunctionNode copy = from.function(node);
+      copy.modifiers = cloneList(from, copy.modifiers);
+      copy.parameters = clone(from, copy.parameters);
+      copy.body = clone(from, copy.body);
+      return add(copy);
+    }
+
+    case NodeType::Parameters: {
+      ParametersNode copy = from.parameters(node);
+      copy.parameters = cloneList(from, copy.parameters);
+      return add(copy);
+    }
+
+    case NodeType::IfStatement: {
+      IfStatementNode copy = from.ifStatement(node);
+      copy.condition = clone(from, copy.condition);
+      copy.ifstatement = clone(from, copy.ifstatement);
+      copy.elsestatement = clone(from, copy.elsestatement);
+      return add(copy);
+    }
+
+    default: {
+      CycleStatementNode copy = from.cycleStatement(node);
+      copy.condition = clone(from, copy.condition);
+      copy.statement = clone(from, copy.statement);
+      return add(copy);
+    }
+    }
   }
 
-  CycleStatementNode::CycleStatementNode(Node *cond, Node *stat, Lexer::Token &beg)
-    : Node(NodeType::WhileStatement, beg), condition(cond), statement(stat) {}
+  NodeId Tree::cloneDeclaration(const Tree &from, NodeId node) {
+    if(node.type() != NodeType::Function)
+      return clone(from, node);
 
-  CycleStatementNode::~CycleStatementNode() {
-    if(condition != nullptr)
-      delete condition;
-    
-    if(statement != nullptr)
-      delete statement;
+    FunctionNode signature = from.function(node);
+    signature.modifiers = cloneList(from, signature.modifiers);
+    signature.parameters = clone(from, signature.parameters);
+    signature.body = NodeId();
 
-    condition = nullptr;
-    statement = nullptr;
+    return add(signature);
   }
 }
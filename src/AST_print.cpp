@@ -4,11 +4,11 @@
 using namespace std;
 
 namespace AST {
-  void StatementsNode::printJSON(string spaces) {
+  static void printStatements(const Tree &tree, const StatementsNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  statements: ";
 
-    for(auto i : statements) {
-      if(i != nullptr) i->printJSON(spaces + "  ");
+    for(auto i : node.statements) {
+      if(i) printJSON(tree, i, source, spaces + "  ");
 
       cout << ", ";
     }
@@ -16,101 +16,134 @@ namespace AST {
     cout << "\b\b\n";
     cout << spaces << "}\n";
   }
-  
-  void VariableNode::printJSON(string spaces) {
+
+  static void printVariable(const Tree &tree, const VariableNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  varType: ";
-    cout << varTypeToken.value << ",\n";
+    cout << node.varTypeToken.value(source) << ",\n";
     cout << spaces << "  modifiers: ";
 
-    for(auto i : modifiers)
-      i->printJSON(spaces + "  ");
+    for(auto i : node.modifiers)
+      printJSON(tree, i, source, spaces + "  ");
 
     cout << '\n';
     cout << spaces << "  variable: ";
-    cout << name.value << ",\n";
+    cout << node.name.value(source) << ",\n";
 
-    if(body != nullptr) {
+    if(node.body) {
       cout << spaces << "  body: ";
-      body->printJSON(spaces + "  ");
+      printJSON(tree, node.body, source, spaces + "  ");
       cout << '\n';
     }
-    
+
     cout << spaces << "}";
   }
 
-  void ValueNode::printJSON(string spaces) {
-    (void)spaces;
+  static void printValue(const ValueNode &node, string_view source) {
     cout << "{ value: ";
-    cout << value.value;
+    cout << node.value.value(source);
     cout << " }";
   }
 
-  void BinaryNode::printJSON(string spaces) {
+  static void printBinary(const Tree &tree, const BinaryNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  operator: ";
-    cout << op.value << ",\n";
+    cout << node.op.value(source) << ",\n";
     cout << spaces << "  left: ";
-    left->printJSON(spaces + "  ");
+    printJSON(tree, node.left, source, spaces + "  ");
     cout << ",\n" << spaces << "  right: ";
-    right->printJSON(spaces + "  ");
+    printJSON(tree, node.right, source, spaces + "  ");
     cout << '\n' << spaces << "}";
   }
 
-  void UnaryNode::printJSON(string spaces) {
+  static void printUnary(const Tree &tree, const UnaryNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  operator: ";
-    cout << op.value << ",\n";
+    cout << node.op.value(source) << ",\n";
     cout << spaces << "  operand: ";
-    node->printJSON(spaces + "  ");
+    printJSON(tree, node.node, source, spaces + "  ");
     cout << '\n' << spaces << "}";
   }
-  
-  void FunctionNode::printJSON(string spaces) {
+
+  static void printFunction(const Tree &tree, const FunctionNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  name: ";
-    cout << name.value << ",\n";
+    cout << node.name.value(source) << ",\n";
     cout << spaces << "  type: ";
-    cout << varTypeToken.value << ",\n";
+    cout << node.varTypeToken.value(source) << ",\n";
     cout << spaces << "  parameters: ";
-    parameters->printJSON(spaces + "  ");
+    printJSON(tree, node.parameters, source, spaces + "  ");
 
-    if(body != nullptr) {
+    if(node.body) {
       cout << ",\n" << spaces << "  body: ";
-      body->printJSON(spaces + "  ");
+      printJSON(tree, node.body, source, spaces + "  ");
       cout << '\n';
     }
-    
+
     cout << spaces << "}";
   }
 
-  void ParametersNode::printJSON(string spaces) {
+  static void printParameters(const Tree &tree, const ParametersNode &node, string_view source, string spaces) {
     cout << "{ ";
 
-    for(auto i : parameters) {
-      i->printJSON(spaces + "  ");
+    for(auto i : node.parameters) {
+      printJSON(tree, i, source, spaces + "  ");
       cout << ", ";
     }
 
     cout << "\b\b\n" << spaces << "}";
   }
 
-  void IfStatementNode::printJSON(std::string spaces) {
+  static void printIfStatement(const Tree &tree, const IfStatementNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  condition: ";
-    condition->printJSON(spaces + "  ");
+    printJSON(tree, node.condition, source, spaces + "  ");
     cout << ",\n" << spaces << "  if: ";
-    ifstatement->printJSON(spaces + "  ");
+    printJSON(tree, node.ifstatement, source, spaces + "  ");
 
-    if(elsestatement != nullptr) {
+    if(node.elsestatement) {
       cout << ",\n" << spaces << "  else: ";
-      elsestatement->printJSON();
+      printJSON(tree, node.elsestatement, source);
       cout << '\n';
     }
 
     cout << spaces << "}";
   }
 
-  void CycleStatementNode::printJSON(std::string spaces) {
+  static void printCycleStatement(const Tree &tree, const CycleStatementNode &node, string_view source, string spaces) {
     cout << "{\n" << spaces << "  condition: ";
-    condition->printJSON(spaces + "  ");
+    printJSON(tree, node.condition, source, spaces + "  ");
     cout << ",\n" << spaces << "  statement: ";
-    statement->printJSON(spaces + "  ");
+    printJSON(tree, node.statement, source, spaces + "  ");
     cout << '\n' << spaces << "}";
   }
+
+  void printJSON(const Tree &tree, NodeId node, string_view source, string spaces) {
+    switch(node.type()) {
+    case NodeType::Statements:
+      printStatements(tree, tree.statements(node), source, spaces);
+      break;
+    case NodeType::Variable:
+      printVariable(tree, tree.variable(node), source, spaces);
+      break;
+    case NodeType::Value:
+      printValue(tree.value(node), source);
+      break;
+    case NodeType::BinaryOperator:
+      printBinary(tree, tree.binary(node), source, spaces);
+      break;
+    case NodeType::UnaryOperator:
+      printUnary(tree, tree.unary(node), source, spaces);
+      break;
+    case NodeType::Function:
+      printFunction(tree, tree.function(node), source, spaces);
+      break;
+    case NodeType::Parameters:
+      printParameters(tree, tree.parameters(node), source, spaces);
+      break;
+    case NodeType::IfStatement:
+      printIfStatement(tree, tree.ifStatement(node), source, spaces);
+      break;
+    case NodeType::WhileStatement:
+      printCycleStatement(tree, tree.cycleStatement(node), source, spaces);
+      break;
+    default:
+      break;
+    }
+  }
 }
@@ -0,0 +1,63 @@
+#include "allocations.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace Allocations {
+  static std::atomic<bool> enabled(false);
+  static thread_local Counts counts;
+
+  static void count(size_t size) {
+    if(!enabled.load(std::memory_order_relaxed))
+      return;
+
+    ++counts.allocations;
+    counts.bytes += size;
+  }
+
+  void enable() {
+    enabled = true;
+  }
+
+  Counts current() {
+    return counts;
+  }
+}
+
+// The other forms of new and delete call these
+void *operator new(size_t size) {
+  Allocations::count(size);
+
+  if(void *ptr = std::malloc(size != 0 ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  Allocations::count(size);
+
+  auto align = static_cast<size_t>(alignment);
+  size_t rounded = size != 0 ? (size + align - 1) / align * align : align;
+
+  if(void *ptr = std::aligned_alloc(align, rounded))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
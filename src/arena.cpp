@@ -0,0 +1,81 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+// Blocks start small so tiny programs stay cheap and double up to the cap
+static constexpr size_t FIRST_BLOCK_SIZE = 64 << 10;
+static constexpr size_t MAX_BLOCK_SIZE = 4 << 20;
+
+namespace AST {
+  Arena::Arena()
+    : cursor(nullptr), limit(nullptr), nextBlockSize(FIRST_BLOCK_SIZE),
+      systemAllocations(0), allocations(0), bytes(0) {}
+
+  Arena::~Arena() {
+    for(auto i : blocks)
+      std::free(i);
+  }
+
+  void Arena::newBlock(size_t minSize) {
+    size_t size = std::max(nextBlockSize, minSize);
+    void *block = std::malloc(size);
+
+    if(!block)
+      throw std::bad_alloc();
+
+    blocks.push_back(block);
+    ++systemAllocations;
+    cursor = static_cast<char*>(block);
+    limit = cursor + size;
+    nextBlockSize = std::min(nextBlockSize * 2, MAX_BLOCK_SIZE);
+  }
+
+  void Arena::reset() {
+    if(blocks.empty())
+      return;
+
+    for(size_t i = 0; i + 1 < blocks.size(); ++i)
+      std::free(blocks[i]);
+
+    blocks.erase(blocks.begin(), blocks.end() - 1);
+    cursor = static_cast<char*>(blocks.back());
+  }
+
+  void *Arena::do_allocate(size_t size, size_t alignment) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+
+    if(!cursor || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+      newBlock(size + alignment);
+      aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+    }
+
+    cursor = reinterpret_cast<char*>(aligned + size);
+    ++allocations;
+    bytes += size;
+
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  void Arena::do_deallocate(void *ptr, size_t size, size_t alignment) {
+    (void) ptr;
+    (void) size;
+    (void) alignment;
+  }
+
+  bool Arena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+  }
+
+  size_t Arena::blockCount() const {
+    return systemAllocations;
+  }
+
+  size_t Arena::allocationCount() const {
+    return allocations;
+  }
+
+  size_t Arena::bytesAllocated() const {
+    return bytes;
+  }
+}
@@ -0,0 +1,132 @@
+#include "cache.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Cache {
+  // Past this the entries in memory are dropped and gathered anew
+  static constexpr size_t MEMORY_LIMIT = size_t(1) << 30;
+
+  // FNV-1a; entries hold their keys, so it only has to spread them
+  static uint64_t hash(std::string_view first, std::string_view second) {
+    uint64_t value = 0xcbf29ce484222325;
+
+    for(auto text : { first, second }) {
+      for(char ch : text) {
+        value ^= static_cast<uint8_t>(ch);
+        value *= 0x100000001b3;
+      }
+    }
+
+    return value;
+  }
+
+  Cache::Cache(std::string directory_, bool inMemory_)
+    : directory(std::move(directory_)), inMemory(inMemory_), memorySize(0), hits(0), misses(0) {
+    struct stat st;
+
+    if(!directory.empty())
+      mkdir(directory.c_str(), 0755);
+
+    if(stat("/proc/self/exe", &st) == 0)
+      compilerIdentity = std::to_string(st.st_size) + ' ' + std::to_string(st.st_mtime) + ' ' +
+        std::to_string(st.st_ino) + '\n';
+  }
+
+  std::string Cache::path(std::string_view key) const {
+    char name[17];
+
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash(compilerIdentity, key)));
+    return directory + '/' + name;
+  }
+
+  void Cache::remember(std::string_view key, std::shared_ptr<const std::string> value) {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+
+    if(memorySize + key.size() + value->size() > MEMORY_LIMIT) {
+      memory.clear();
+      memorySize = 0;
+    }
+
+    Entry &entry = memory[hash(key, {})];
+
+    if(entry.value)
+      memorySize -= entry.key.size() + entry.value->size();
+
+    entry.key = key;
+    entry.value = std::move(value);
+    memorySize += key.size() + entry.value->size();
+  }
+
+  std::shared_ptr<const std::string> Cache::load(std::string_view key) {
+    if(inMemory) {
+      std::lock_guard<std::mutex> lock(memoryMutex);
+      auto entry = memory.find(hash(key, {}));
+
+      if(entry != memory.end() && entry->second.key == key) {
+        ++hits;
+        return entry->second.value;
+      }
+    }
+
+    std::ifstream file;
+    std::string entry;
+
+    if(!directory.empty())
+      file.open(path(key), std::ios::binary);
+
+    if(file)
+      entry.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    std::string header = compilerIdentity + std::to_string(key.size()) + '\n';
+
+    if(entry.size() < header.size() + key.size() || std::string_view(entry).substr(0, header.size()) != header ||
+       std::string_view(entry).substr(header.size(), key.size()) != key) {
+      ++misses;
+      return nullptr;
+    }
+
+    ++hits;
+    entry.erase(0, header.size() + key.size());
+
+    auto value = std::make_shared<const std::string>(std::move(entry));
+
+    if(inMemory)
+      remember(key, value);
+
+    return value;
+  }
+
+  void Cache::store(std::string_view key, std::string value) {
+    static std::atomic<unsigned> temporaries(0);
+
+    auto shared = std::make_shared<const std::string>(std::move(value));
+
+    if(inMemory)
+      remember(key, shared);
+
+    if(directory.empty())
+      return;
+
+    std::string name = path(key);
+    std::string temporary = name + '.' + std::to_string(getpid()) + '.' + std::to_string(temporaries++);
+
+    {
+      std::ofstream file(temporary, std::ios::binary);
+
+      file << compilerIdentity << key.size() << '\n' << key << *shared;
+
+      if(!file.flush()) {
+        file.close();
+        std::remove(temporary.c_str());
+        return;
+      }
+    }
+
+    if(std::rename(temporary.c_str(), name.c_str()) != 0)
+      std::remove(temporary.c_str());
+  }
+}
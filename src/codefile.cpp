@@ -1,13 +1,86 @@
 #include "codefile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace CodeFile {
   CodeFile::CodeFile(const std::string &filename)
-    : fileName(filename) {
-    std::ifstream file(filename);
+    : mapping(nullptr), mappingSize(0), fileName(filename), readable(true) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+
+    if(fd < 0) {
+      readable = false;
+      indexLines();
+      return;
+    }
+
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+      close(fd);
+      readStream();
+      return;
+    }
+
+    mappingSize = static_cast<size_t>(st.st_size);
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(mapping == MAP_FAILED) {
+      mapping = nullptr;
+      mappingSize = 0;
+      readStream();
+      return;
+    }
+
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+    fileData = std::string_view(static_cast<const char*>(mapping), mappingSize);
+    indexLines();
+  }
+
+  // Fallback for inputs that can't be mapped (pipes, character devices)
+  void CodeFile::readStream() {
+    std::ifstream file(fileName);
     std::stringstream sstream;
 
+    if(!file)
+      readable = false;
+
     sstream << file.rdbuf();
-    fileData = sstream.str();
-    fileName = filename;
+    buffer = sstream.str();
+    fileData = buffer;
+    indexLines();
+  }
+
+  // Offsets of line beginnings, found once with memchr so that diagnostics
+  // can map an offset to its line by binary search
+  void CodeFile::indexLines() {
+    const char *begin = fileData.data();
+    const char *end = begin + fileData.size();
+
+    lineBegins.push_back(0);
+
+    if(tooLarge())
+      return;
+
+    for(const char *p = begin; (p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)))) != nullptr; )
+      lineBegins.push_back(static_cast<uint32_t>(++p - begin));
+  }
+
+  size_t CodeFile::getLineNumber(size_t offset) const {
+    return static_cast<size_t>(std::upper_bound(lineBegins.begin(), lineBegins.end(), offset) - lineBegins.begin()) - 1;
+  }
+
+  bool CodeFile::tooLarge() const {
+    return fileData.size() > MAX_SIZE;
+  }
+
+  CodeFile::~CodeFile() {
+    if(mapping != nullptr)
+      munmap(mapping, mappingSize);
   }
 }
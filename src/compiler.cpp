@@ -1,266 +1,229 @@
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <exception>
 #include <string>
 #include <system_error>
 #include <tuple>
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
 #include <type_traits>
 #include <unordered_map>
 #include <iostream>
 #include <functional>
+#include <memory>
+#include <chrono>
 
 #include "compiler.hpp"
 #include "AST.hpp"
+#include "lexer.hpp"
 #include "lexer_token.hpp"
 #include "parser.hpp"
 #include "asmtype.hpp"
 #include "variable.hpp"
 #include "scope.hpp"
 #include "arch.hpp"
+#include "thread_pool.hpp"
+#include "output_buffer.hpp"
+#include "mir.hpp"
+#include "elf.hpp"
+#include "cache.hpp"
+#include "semantic.hpp"
+#include "time_report.hpp"
 
 using namespace Compiler;
 using namespace Parser;
 using namespace AST;
 using namespace std;
+using namespace MIR;
 
-inline bool isVariable(Node *node) {
-  return node->type == NodeType::Value &&
-    static_cast<ValueNode*>(node)->value.type == Lexer::Type::Identifier;
-}
-
-bool NonsenseCompiler::compareOperandsTypes(Type &first, Type &second) {
-  if(first.type == "#ctint" || second.type == "#ctint")
-    return true;
-
-  AssemblerType &firstAsmType = first.pointerLevel != 0 ? NAT_ASMTYPE : typesMap.find(first.type)->second;
-  AssemblerType &secondAsmType = second.pointerLevel != 0 ? NAT_ASMTYPE : typesMap.find(second.type)->second;
-
-  return firstAsmType.asmname == secondAsmType.asmname;
-}
-
-void NonsenseCompiler::compileVariableAddress(AST::ValueNode *varNode) {
-  Variable &var = getVariable(varNode);
-
-  if(varNode->exprType.isNull())
-    varNode->exprType = var.node->exprType;
-
-  if(currentScope->variables.find(varNode->value.value) != currentScope->variables.end())
-    currentScope->text += "mov " NAT_AX ", " NAT_BP "\n" "sub " NAT_AX ", " + to_string(var.stackOffset) + '\n';
-  else if(global.variables.find(varNode->value.value) != global.variables.end())
-    currentScope->text += "mov " NAT_AX ", " + var.node->name.value + '\n';
-}
-
-void NonsenseCompiler::compileGlobalVariable(AST::ValueNode *varNode) {
-  Variable &var = global.variables.find(varNode->value.value)->second;
+// Directives defining initialized data, indexed by Size
+static constexpr string_view DATA_DIRECTIVES[] = { "", "db", "", "", "dq" };
 
-  if(varNode->exprType.isNull())
-    varNode->exprType = var.node->exprType;
+void NonsenseCompiler::compileVariableAddress(AST::ValueNode &varNode) {
+  Variable &var = *varNode.variable;
 
-  if(var.asmtype.asmname == NAT_TYPE) {
-    currentScope->text +=
-      "mov " NAT_AX ", " + var.asmtype.asmname + "[" + var.node->name.value + "]\n";
+  if(var.isLocal) {
+    emit(Opcode::Mov, reg(NAT_AX), reg(NAT_BP));
+    emit(Opcode::Sub, reg(NAT_AX), imm(static_cast<int64_t>(var.stackOffset)));
   } else {
-    currentScope->text +=
-      "movzx " NAT_AX ", " + var.asmtype.asmname + "[" + var.node->name.value + "]\n";
+    emit(Opcode::Mov, reg(NAT_AX), symbol(var.node->name));
   }
 }
 
-void NonsenseCompiler::compileLocalVariable(AST::ValueNode *varNode) {
-  Variable &var = currentScope->variables.find(varNode->value.value)->second;
+void NonsenseCompiler::compileGlobalVariable(AST::ValueNode &varNode) {
+  Variable &var = *varNode.variable;
 
-  if(varNode->exprType.isNull())
-    varNode->exprType = var.node->exprType;
+  if(var.asmtype->width == NAT_TYPE)
+    emit(Opcode::Mov, reg(NAT_AX), mem(var.asmtype->width, var.node->name));
+  else
+    emit(Opcode::Movzx, reg(NAT_AX), mem(var.asmtype->width, var.node->name));
+}
 
-  if(var.asmtype.asmname == NAT_TYPE) {
-    currentScope->text +=
-      "mov " NAT_AX ", " + var.asmtype.asmname + "[" NAT_BP "-" + to_string(var.stackOffset) + "]\n";
-  } else {
-    currentScope->text +=
-      "movzx " NAT_AX ", " + var.asmtype.asmname + "[" NAT_BP "-" + to_string(var.stackOffset) + "]\n";
-  }
+void NonsenseCompiler::compileLocalVariable(AST::ValueNode &varNode) {
+  Variable &var = *varNode.variable;
+
+  if(var.asmtype->width == NAT_TYPE)
+    emit(Opcode::Mov, reg(NAT_AX), local(var));
+  else
+    emit(Opcode::Movzx, reg(NAT_AX), local(var));
 }
 
-void NonsenseCompiler::compileVariable(AST::ValueNode *varNode) {
-  if(currentScope->variables.find(varNode->value.value) != currentScope->variables.end()) {
+void NonsenseCompiler::compileVariable(AST::ValueNode &varNode) {
+  if(varNode.variable->isLocal)
     compileLocalVariable(varNode);
-  } else if(global.variables.find(varNode->value.value) != global.variables.end()) {
+  else
     compileGlobalVariable(varNode);
-  } else if(global.functions.find(varNode->value.value) != global.functions.end()) {
-    Variable &var = currentScope->variables.find(varNode->value.value)->second;
-
-    if(varNode->exprType.isNull())
-      varNode->exprType = var.node->exprType;
-
-    currentScope->text +=
-      "mov " NAT_AX ", " + varNode->value.value + '\n';
-  } else {
-    throw Error(varNode->begin, "Undefined variable '" + varNode->value.value + "'");
-  }
 }
 
-void NonsenseCompiler::compileValue(AST::ValueNode *val) {
-  if(val->exprType.isNull())
-    val->exprType = getValueType(val);
-
-  switch(val->value.type) {
+void NonsenseCompiler::compileValue(AST::ValueNode &val) {
+  switch(val.value.type) {
   case Lexer::Type::Integer:
-    currentScope->text += "mov " NAT_AX ", " + val->value.value + '\n';
-    break;
-
   case Lexer::Type::Char:
-    currentScope->text += "mov " NAT_AX ", " + to_string((int)val->value.value[1]) + "\n";
+    emit(Opcode::Mov, reg(NAT_AX), imm(val.value.integer));
     break;
 
   case Lexer::Type::String:
-    global.stringLiterals.push_back(val->value.value);
-    currentScope->text += "mov " NAT_AX ", __string_literal_" + to_string(global.stringLiterals.size()) + '\n';
+    currentScope->stringLiterals.push_back(Lexer::decodeString(value(val.value)));
+    emit(Opcode::Mov, reg(NAT_AX), stringLiteral(currentScope->stringLiterals.size()));
     break;
 
-  case Lexer::Type::Identifier: {
-    auto var = getVariable(val);
-
-    if(var.variableType == VariableType::StaticArray)
+  case Lexer::Type::Identifier:
+    if(val.variable->variableType == VariableType::StaticArray)
       compileVariableAddress(val);
     else
       compileVariable(val);
 
-    if(val->exprType.isNull())
-      val->exprType = getValueType(val);
-
     break;
-  }
 
   default:
-    throw Error(val->begin, "Not implemented #1");
+    break;
   }
-
-  if(val->exprType.isNull())
-    val->exprType = getValueType(val);
 }
 
-static unordered_map<Lexer::OperatorType, string> BIN_OPERATORS_N_O = {
-  { Lexer::OperatorType::Plus, "add " NAT_AX ", " NAT_BX "\n" },
-  { Lexer::OperatorType::Minus, "sub " NAT_AX ", " NAT_BX "\n" },
-  { Lexer::OperatorType::Multiply, "imul " NAT_BX "\n" },
-  { Lexer::OperatorType::Divide, "mov " NAT_DX ", 0\n" "idiv " NAT_BX "\n" },
-  { Lexer::OperatorType::Percent,   "mov " NAT_DX ", 0\n" "idiv " NAT_BX "\n" "mov " NAT_AX ", " NAT_DX "\n" },
-  { Lexer::OperatorType::More, "cmp " NAT_AX ", " NAT_BX "\n" "setg al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n" },
-  { Lexer::OperatorType::Less, "cmp " NAT_AX ", " NAT_BX "\n" "setl al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n" },
-  { Lexer::OperatorType::Equals, "cmp " NAT_AX ", " NAT_BX "\n" "sete al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n" },
-  { Lexer::OperatorType::NotEquals, "cmp " NAT_AX ", " NAT_BX "\n" "setne al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n" },
-  { Lexer::OperatorType::And, "and " NAT_AX ", " NAT_BX "\n" },
-  { Lexer::OperatorType::Or, "or " NAT_AX ", " NAT_BX "\n" },
+// Instructions held before the finished blocks of a function are printed
+static constexpr size_t PRINT_THRESHOLD = 1 << 16;
+
+// Operators done by one instruction on the accumulator
+static const unordered_map<Lexer::OperatorType, Opcode> ACCUMULATOR_OPCODES = {
+  { Lexer::OperatorType::Plus, Opcode::Add },
+  { Lexer::OperatorType::Minus, Opcode::Sub },
+  { Lexer::OperatorType::And, Opcode::And },
+  { Lexer::OperatorType::Or, Opcode::Or },
+  { Lexer::OperatorType::BinAnd, Opcode::And },
+  { Lexer::OperatorType::BinOr, Opcode::Or },
 };
 
-static unordered_map<Lexer::OperatorType, function<string(string right)>> BIN_OPERATORS_O = {
-  { Lexer::OperatorType::Plus, [](string right) -> string { return "add " NAT_AX ", " + right + "\n"; } },
-  { Lexer::OperatorType::Minus, [](string right) -> string { return "sub " NAT_AX ", " + right + "\n"; } },
-  { Lexer::OperatorType::More, [](string right) -> string {
-      return "cmp " NAT_AX ", " + right + "\n" "setg al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n"; } },
-  { Lexer::OperatorType::Less, [](string right) -> string {
-      return "cmp " NAT_AX ", " + right + "\n" "setl al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n"; } },
-  { Lexer::OperatorType::Equals, [](string right) -> string {
-      return "cmp " NAT_AX ", " + right + "\n" "sete al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n"; } },
-  { Lexer::OperatorType::NotEquals, [](string right) -> string {
-      return "cmp " NAT_AX ", " + right + "\n" "setne al\n" "and al, 0x01\n" "movzx " NAT_AX ", al\n"; } },
-  { Lexer::OperatorType::And, [](string right) -> string { return "and " NAT_AX ", " + right + "\n"; } },
-  { Lexer::OperatorType::Or, [](string right) -> string { return "or " NAT_AX ", " + right + "\n"; } },
+// Comparisons, which leave 0 or 1 in the accumulator
+static const unordered_map<Lexer::OperatorType, Opcode> COMPARISON_OPCODES = {
+  { Lexer::OperatorType::More, Opcode::Setg },
+  { Lexer::OperatorType::Less, Opcode::Setl },
+  { Lexer::OperatorType::Equals, Opcode::Sete },
+  { Lexer::OperatorType::NotEquals, Opcode::Setne },
+  { Lexer::OperatorType::MoreOrEquals, Opcode::Setge },
+  { Lexer::OperatorType::LessOrEquals, Opcode::Setle },
 };
 
-static unordered_map<string, pair<string, string>> TYPES_RES_LABELS = {
-  { "qword", { "dq", "resq" } },
-  { "byte", { "db", "resb" } }
-};
-
-void NonsenseCompiler::compileNotOptimizableBinaryOperator(BinaryNode *bin) {
-  compileFormula(bin->left);
-  currentScope->text += "push " NAT_AX "\n";
-  compileFormula(bin->right);
-
-  if(!compareOperandsTypes(bin->left->exprType, bin->right->exprType))
-    throw Error(bin->begin, "Incompatible types of operands");
-
-  currentScope->text +=
-    "mov " NAT_BX ", " NAT_AX "\n"
-    "pop " NAT_AX "\n" +
-    BIN_OPERATORS_N_O[bin->op.operatorType];
+MIR::Code::Position NonsenseCompiler::emit(Opcode opcode, const Operand &first, const Operand &second) {
+  return currentScope->code.emit(opcode, first, second);
 }
 
-void NonsenseCompiler::compileOptimizableBinaryOperator(BinaryNode *bin) {
-  compileFormula(bin->left);
-
-  if(bin->right->type == NodeType::Value) {
-    auto vn = static_cast<ValueNode*>(bin->right);
-    string right = vn->value.type == Lexer::Type::Char ? to_string((int)vn->value.value[1]) : vn->value.value;
-    currentScope->text += BIN_OPERATORS_O[bin->op.operatorType](right);
-
-    if(bin->right->exprType.isNull())
-      bin->right->exprType = getValueType(static_cast<ValueNode*>(bin->right));
-  } else {
-    currentScope->text += "push " NAT_AX "\n";
-    compileFormula(bin->right);
+MIR::Operand NonsenseCompiler::local(const Variable &var) {
+  return mem(var.asmtype->width, NAT_BP, -static_cast<int64_t>(var.stackOffset));
+}
 
-    if(!compareOperandsTypes(bin->left->exprType, bin->right->exprType))
-      throw Error(bin->begin, "Incompatible types of operands");
+// Applies the operator of bin to the accumulator and right
+void NonsenseCompiler::compileOperator(BinaryNode &bin, Operand right) {
+  auto accumulator = ACCUMULATOR_OPCODES.find(bin.op.operatorType);
 
-    currentScope->text +=
-      "mov " NAT_BX ", " NAT_AX "\n"
-      "pop " NAT_AX "\n" +
-      BIN_OPERATORS_N_O[bin->op.operatorType];
+  if(accumulator != ACCUMULATOR_OPCODES.end()) {
+    emit(accumulator->second, reg(NAT_AX), right);
+    return;
   }
-}
 
-Variable &NonsenseCompiler::getVariable(ValueNode *var) {
-  if(currentScope->variables.find(var->value.value) != currentScope->variables.end())
-    return currentScope->variables.find(var->value.value)->second;
+  auto comparison = COMPARISON_OPCODES.find(bin.op.operatorType);
 
-  if(global.variables.find(var->value.value) != global.variables.end())
-    return global.variables.find(var->value.value)->second;
-
-  throw Error(var->begin, "Undefined variable '" + var->value.value + "'");
-}
+  if(comparison != COMPARISON_OPCODES.end()) {
+    emit(Opcode::Cmp, reg(NAT_AX), right);
+    emit(comparison->second, reg(Reg::AL));
+    emit(Opcode::And, reg(Reg::AL), hex(1));
+    emit(Opcode::Movzx, reg(NAT_AX), reg(Reg::AL));
+    return;
+  }
 
-Type NonsenseCompiler::getValueType(ValueNode *val) {
-  switch (val->value.type) {
-  case Lexer::Type::String:
-    return Type("byte", 1, false);
+  switch(bin.op.operatorType) {
+  case Lexer::OperatorType::Multiply:
+    emit(Opcode::Imul, right);
+    break;
 
-  case Lexer::Type::Integer:
-    return Type("#ctint", 0, false);
+  case Lexer::OperatorType::Divide:
+    emit(Opcode::Mov, reg(NAT_DX), imm(0));
+    emit(Opcode::Idiv, right);
+    break;
 
-  case Lexer::Type::Char:
-    return Type("#ctint", 0, false);
+  case Lexer::OperatorType::Percent:
+    emit(Opcode::Mov, reg(NAT_DX), imm(0));
+    emit(Opcode::Idiv, right);
+    emit(Opcode::Mov, reg(NAT_AX), reg(NAT_DX));
+    break;
 
-  case Lexer::Type::Identifier:
-    return getVariable(val).node->exprType;
+  // Repeated multiplication; negative exponents give 1
+  case Lexer::OperatorType::Pow: {
+    int64_t labelnum = ++currentScope->labelCount;
+
+    emit(Opcode::Mov, reg(Reg::RCX), reg(NAT_AX));
+    emit(Opcode::Mov, reg(NAT_AX), imm(1));
+    currentScope->code.label(label(LabelKind::Pow, labelnum));
+    emit(Opcode::Cmp, right, imm(0));
+    emit(Opcode::Jle, label(LabelKind::EndPow, labelnum));
+    emit(Opcode::Imul, reg(NAT_AX), reg(Reg::RCX));
+    emit(Opcode::Dec, right);
+    emit(Opcode::Jmp, label(LabelKind::Pow, labelnum));
+    currentScope->code.label(label(LabelKind::EndPow, labelnum));
+    break;
+  }
 
   default:
-    throw Error(val->begin, "Not implemented #4");
+    throw Error(bin.op.offset, "Unknown binary operator");
   }
 }
 
-Type NonsenseCompiler::getExpressionType(Node *node) {
-  switch (node->type) {
-  case NodeType::BinaryOperator:
-    return static_cast<BinaryNode*>(node)->exprType;
+void NonsenseCompiler::compileNotOptimizableBinaryOperator(BinaryNode &bin) {
+  compileFormula(bin.left);
+  emit(Opcode::Push, reg(NAT_AX));
+  compileFormula(bin.right);
+  emit(Opcode::Mov, reg(NAT_BX), reg(NAT_AX));
+  emit(Opcode::Pop, reg(NAT_AX));
+  compileOperator(bin, reg(NAT_BX));
+}
 
-  case NodeType::UnaryOperator:
-    return static_cast<UnaryNode*>(node)->exprType;
+void NonsenseCompiler::compileOptimizableBinaryOperator(BinaryNode &bin) {
+  compileFormula(bin.left);
 
-  case NodeType::Value:
-    return getValueType(static_cast<ValueNode*>(node));
+  if(bin.right.type() == NodeType::Value) {
+    const ValueNode &vn = tree->value(bin.right);
 
-  default:
-    throw Error(node->begin, "Can't get type of this statement");
+    if(vn.value.type == Lexer::Type::Char || vn.value.type == Lexer::Type::Integer)
+      compileOperator(bin, imm(vn.value.integer));
+    else
+      compileOperator(bin, text(vn.value));
+  } else {
+    emit(Opcode::Push, reg(NAT_AX));
+    compileFormula(bin.right);
+    emit(Opcode::Mov, reg(NAT_BX), reg(NAT_AX));
+    emit(Opcode::Pop, reg(NAT_AX));
+    compileOperator(bin, reg(NAT_BX));
   }
 }
 
-void NonsenseCompiler::compileAssignLeftOperand(AST::Node *opd) {
-  switch (opd->type) {
+void NonsenseCompiler::compileAssignLeftOperand(AST::NodeId opd) {
+  switch (opd.type()) {
   case NodeType::BinaryOperator: {
-    auto bin = static_cast<BinaryNode*>(opd);
+    BinaryNode &bin = tree->binary(opd);
 
-    if(bin->op.operatorType == Lexer::OperatorType::LeftSquareParen)
+    if(bin.op.operatorType == Lexer::OperatorType::LeftSquareParen)
       compileIndexToAssign(bin);
     else
       compileBinary(bin);
@@ -269,122 +232,83 @@ void NonsenseCompiler::compileAssignLeftOperand(AST::Node *opd) {
   }
 
   case NodeType::UnaryOperator: {
-    auto unr = static_cast<UnaryNode*>(opd);
+    UnaryNode &unr = tree->unary(opd);
 
-    if(unr->op.operatorType == Lexer::OperatorType::At && isVariable(unr->node)) {
-      if(getVariable(static_cast<ValueNode*>(unr->node)).variableType == VariableType::StaticArray) {
-        compileVariableAddress(static_cast<ValueNode*>(unr->node));
-        unr->exprType = getValueType(static_cast<ValueNode*>(unr->node));
-        --unr->exprType.pointerLevel;
-      } else {
-        compileVariable(static_cast<ValueNode*>(unr->node));
-        unr->exprType = getValueType(static_cast<ValueNode*>(unr->node));
-        --unr->exprType.pointerLevel;
-      }
+    if(unr.op.operatorType == Lexer::OperatorType::At && tree->isVariable(unr.node)) {
+      ValueNode &varNode = tree->value(unr.node);
 
-      break;
-    }
-
-    compileFormula(unr->node);
+      if(varNode.variable->variableType == VariableType::StaticArray)
+        compileVariableAddress(varNode);
+      else
+        compileVariable(varNode);
 
-    if(unr->exprType.isNull()) {
-      unr->exprType = unr->node->exprType;
-      --unr->exprType.pointerLevel;
+      break;
     }
 
+    compileFormula(unr.node);
     break;
   }
 
   case NodeType::Value:
-    if(isVariable(opd))
-      compileVariableAddress(static_cast<ValueNode*>(opd));
+    if(tree->isVariable(opd))
+      compileVariableAddress(tree->value(opd));
     else
-      compileValue(static_cast<ValueNode*>(opd));
+      compileValue(tree->value(opd));
 
     break;
 
   default:
-    throw Error(opd->begin, "Not implemented #2");
     break;
   }
 }
 
-void NonsenseCompiler::compileIndex(AST::BinaryNode *bin) {
-  compileFormula(bin->left);
-  currentScope->text += "push " NAT_AX "\n";
-  compileFormula(bin->right);
-
-  bin->exprType = bin->left->exprType;
-
-  if(bin->exprType.pointerLevel == 0)
-    throw Error(bin->op, "The indexing operation requires a pointer");
-
-  --bin->exprType.pointerLevel;
-
-  AssemblerType &asmtype = bin->exprType.pointerLevel != 0
-    ? NAT_ASMTYPE
-    : typesMap.find(bin->exprType.type)->second;
+void NonsenseCompiler::compileIndex(AST::BinaryNode &bin) {
+  compileFormula(bin.left);
+  emit(Opcode::Push, reg(NAT_AX));
+  compileFormula(bin.right);
 
-  currentScope->text +=
-    "mov " NAT_BX ", " + to_string(asmtype.size) + "\n"
-    "mul " NAT_BX "\n";
+  const AssemblerType &asmtype = asmType(bin.exprType);
 
-  currentScope->text +=
-    "mov " NAT_BX ", " NAT_AX "\n"
-    "pop " NAT_AX "\n" +
-    BIN_OPERATORS_N_O[Lexer::OperatorType::Plus];
+  emit(Opcode::Mov, reg(NAT_BX), imm(static_cast<int64_t>(asmtype.size)));
+  emit(Opcode::Mul, reg(NAT_BX));
+  emit(Opcode::Mov, reg(NAT_BX), reg(NAT_AX));
+  emit(Opcode::Pop, reg(NAT_AX));
+  emit(Opcode::Add, reg(NAT_AX), reg(NAT_BX));
 }
 
-void NonsenseCompiler::compileIndexToAssign(AST::BinaryNode *bin) {
+void NonsenseCompiler::compileIndexToAssign(AST::BinaryNode &bin) {
   compileIndex(bin);
 }
-void NonsenseCompiler::compileIndexInFormula(AST::BinaryNode *bin) {
+void NonsenseCompiler::compileIndexInFormula(AST::BinaryNode &bin) {
   compileIndex(bin);
 
-  AssemblerType &asmtype = bin->exprType.pointerLevel != 0
-    ? NAT_ASMTYPE
-    : typesMap.find(bin->exprType.type)->second;
+  const AssemblerType &asmtype = asmType(bin.exprType);
 
-  if(asmtype.asmname == NAT_ASMTYPE.asmname)
-    currentScope->text += "mov " NAT_AX ", qword[" NAT_AX "]\n";
+  if(asmtype.width == NAT_TYPE)
+    emit(Opcode::Mov, reg(NAT_AX), mem(Size::Qword, NAT_AX));
   else
-    currentScope->text += "movzx " NAT_AX ", " + asmtype.asmname + "[" NAT_AX "]\n";
+    emit(Opcode::Movzx, reg(NAT_AX), mem(asmtype.width, NAT_AX));
 }
 
-void NonsenseCompiler::compileAssign(AST::BinaryNode *bin) {
-  auto presetType = bin->exprType;
+void NonsenseCompiler::compileAssign(AST::BinaryNode &bin) {
+  compileAssignLeftOperand(bin.left);
+  emit(Opcode::Push, reg(NAT_AX));
+  compileFormula(bin.right);
 
-  if(currentScope == &global)
-    throw Error(bin->begin, "Unexpected assign in global");
+  const AssemblerType &asmtype = asmType(bin.exprType);
 
-  compileAssignLeftOperand(bin->left);
-  currentScope->text += "push " NAT_AX "\n";
-  compileFormula(bin->right);
+  emit(Opcode::Mov, reg(NAT_BX), reg(NAT_AX));
+  emit(Opcode::Pop, reg(NAT_AX));
+  emit(Opcode::Mov, mem(asmtype.width, NAT_AX), reg(asmtype.baseRegs[1]));
 
-  if(!compareOperandsTypes(bin->left->exprType, bin->right->exprType))
-    throw Error(bin->begin, "Incompatible types of operands 1");
-
-  bin->exprType = bin->left->exprType;
-  AssemblerType &asmtype = bin->exprType.pointerLevel != 0
-    ? NAT_ASMTYPE
-    : typesMap.find(bin->exprType.type)->second;
-
-  currentScope->text +=
-    "mov " NAT_BX ", " NAT_AX "\n"
-    "pop " NAT_AX "\n"
-    "mov " + asmtype.asmname + "[" NAT_AX "], " + asmtype.baseRegs[1] + '\n';
-
-  if(asmtype.asmname == NAT_TYPE)
-    currentScope->text += "mov " NAT_AX ", " + asmtype.asmname + "[" NAT_AX "]\n";
+  if(asmtype.width == NAT_TYPE)
+    emit(Opcode::Mov, reg(NAT_AX), mem(asmtype.width, NAT_AX));
   else
-    currentScope->text += "movzx " NAT_AX ", " + asmtype.asmname + "[" NAT_AX "]\n";
-
-  if(presetType.isNull())
-    bin->exprType = bin->left->exprType;
+    emit(Opcode::Movzx, reg(NAT_AX), mem(asmtype.width, NAT_AX));
 }
 
-void NonsenseCompiler::compileBinary(AST::BinaryNode *bin) {
-  switch(bin->op.operatorType) {
+void NonsenseCompiler::compileBinary(AST::BinaryNode &bin) {
+  switch(bin.op.operatorType) {
   case Lexer::OperatorType::Assign:
     compileAssign(bin);
     return;
@@ -395,269 +319,219 @@ void NonsenseCompiler::compileBinary(AST::BinaryNode *bin) {
     break;
   }
 
-  if(BIN_OPERATORS_O.find(bin->op.operatorType) != BIN_OPERATORS_O.end() && !isVariable(bin->right))
+  if((ACCUMULATOR_OPCODES.count(bin.op.operatorType) != 0 || COMPARISON_OPCODES.count(bin.op.operatorType) != 0) &&
+     !tree->isVariable(bin.right))
     compileOptimizableBinaryOperator(bin);
   else
     compileNotOptimizableBinaryOperator(bin);
-
-  if(!compareOperandsTypes(bin->left->exprType, bin->right->exprType)) {
-    throw Error(bin->begin, "Incompatible types of operands");
-  }
-
-  if(bin->exprType.isNull())
-    bin->exprType = bin->left->exprType.type == "#ctint" ? bin->right->exprType : bin->left->exprType;
 }
 
-void NonsenseCompiler::compileAsmIncluding(ParametersNode *strings) {
-  for(auto i : strings->parameters) {
-    if(i->type == NodeType::Value && static_cast<ValueNode*>(i)->value.type == Lexer::Type::String) {
-      auto &str = static_cast<ValueNode*>(i)->value.value;
-
-      currentScope->text += str.substr(1, str.size() - 2) + '\n';
-    } else {
-      throw Error(i->begin, "Expected string literal");
-    }
-  }
+void NonsenseCompiler::compileAsmIncluding(AST::NodeId strings) {
+  for(auto i : tree->parameters(strings).parameters)
+    currentScope->code.raw(Lexer::decodeString(value(tree->value(i).value)));
 }
 
-void NonsenseCompiler::compileCall(AST::UnaryNode *fnNode) {
-  ParametersNode *args = static_cast<ParametersNode*>(fnNode->node);
-  auto func = global.functions.find(fnNode->op.value);
-
-  if(func == global.functions.end())
-    throw Error(fnNode->begin, "Undefined function");
-
-  if(func->second.node->parameters->parameters.size() != args->parameters.size())
-    throw Error(fnNode->begin, "Not enough arguments");
-
-  if(func->second.node->parameters->parameters.size() < args->parameters.size())
-    throw Error(args->begin, "Too many arguments");
-
-  if(fnNode->exprType.isNull())
-    fnNode->exprType = global.functions.find(fnNode->op.value)->second.node->exprType;
-
-  for(size_t i = 0; i < args->parameters.size(); ++i) {
-    Node *arg = args->parameters[i];
+void NonsenseCompiler::compileCall(AST::UnaryNode &fnNode) {
+  NodeList args = tree->parameters(fnNode.node).parameters;
 
-    if(arg->type == NodeType::Value && !isVariable(arg) &&
-       static_cast<ValueNode*>(arg)->value.type != Lexer::Type::String) {
-      auto val = static_cast<ValueNode*>(arg);
+  for(auto arg : args) {
+    if(arg.type() == NodeType::Value && !tree->isVariable(arg) &&
+       tree->value(arg).value.type != Lexer::Type::String) {
+      const ValueNode &val = tree->value(arg);
 
-      if(val->value.type == Lexer::Type::Char)
-        currentScope->text += "push " + to_string(static_cast<int>(val->value.value[1])) + '\n';
+      if(val.value.type == Lexer::Type::Char)
+        emit(Opcode::Push, imm(val.value.integer));
       else
-        currentScope->text += "push " + val->value.value + '\n';
+        emit(Opcode::Push, text(val.value));
     } else {
       compileFormula(arg);
-
-      if(func->second.node->parameters->parameters[i]->exprType != args->parameters[i]->exprType)
-        throw Error(args->parameters[i]->begin, "Unexpected argument type");
-
-      currentScope->text += "push " NAT_AX "\n";
+      emit(Opcode::Push, reg(NAT_AX));
     }
   }
 
-  for(long int i = static_cast<long int>(args->parameters.size()) - 1; i >= 0 ; --i)
-    currentScope->text += "pop " + parametersRegList[i] + '\n';
+  for(long int i = static_cast<long int>(args.size()) - 1; i >= 0 ; --i)
+    emit(Opcode::Pop, reg(parametersRegList[i]));
 
-  currentScope->text += "call " + fnNode->op.value + '\n';
+  emit(Opcode::Call, symbol(fnNode.op));
 }
 
-void NonsenseCompiler::compileIfStatement(AST::IfStatementNode *ifstat) {
-  string labelnum = to_string((intptr_t)ifstat);
+void NonsenseCompiler::compileIfStatement(const AST::IfStatementNode &ifstat) {
+  int64_t labelnum = ++currentScope->labelCount;
 
-  compileFormula(ifstat->condition);
-  currentScope->text += "cmp " NAT_AX ", 0x00\n" "je .endif_" + labelnum + '\n';
+  compileFormula(ifstat.condition);
+  emit(Opcode::Cmp, reg(NAT_AX), hex(0));
+  emit(Opcode::Je, label(LabelKind::EndIf, labelnum));
 
-  if(ifstat->ifstatement->type == NodeType::Statements)
-    compileStatements(static_cast<StatementsNode*>(ifstat->ifstatement));
+  if(ifstat.ifstatement.type() == NodeType::Statements)
+    compileStatements(ifstat.ifstatement);
   else
-    compileStatement(ifstat->ifstatement);
+    compileStatement(ifstat.ifstatement);
 
-  if(ifstat->elsestatement == nullptr) {
-    currentScope->text += ".endif_" + labelnum + ":\n";
+  if(!ifstat.elsestatement) {
+    currentScope->code.label(label(LabelKind::EndIf, labelnum));
     return;
   }
 
-  currentScope->text += "jmp .endelse_" + labelnum + '\n';
-  currentScope->text += ".endif_" + labelnum + ":\n";
+  emit(Opcode::Jmp, label(LabelKind::EndElse, labelnum));
+  currentScope->code.label(label(LabelKind::EndIf, labelnum));
 
-  if(ifstat->ifstatement->type == NodeType::Statements)
-    compileStatements(static_cast<StatementsNode*>(ifstat->elsestatement));
+  if(ifstat.elsestatement.type() == NodeType::Statements)
+    compileStatements(ifstat.elsestatement);
   else
-    compileStatement(ifstat->elsestatement);
+    compileStatement(ifstat.elsestatement);
 
-  currentScope->text += ".endelse_" + labelnum + ":\n";
+  currentScope->code.label(label(LabelKind::EndElse, labelnum));
 
 }
 
-void NonsenseCompiler::compileWhileStatement(AST::CycleStatementNode *whilestat) {
-  string labelnum = to_string((intptr_t)whilestat);
+void NonsenseCompiler::compileWhileStatement(const AST::CycleStatementNode &whilestat) {
+  int64_t labelnum = ++currentScope->labelCount;
 
-  currentScope->text += ".beginwhile_" + labelnum + ":\n";
-  compileFormula(whilestat->condition);
-  currentScope->text += "cmp " NAT_AX ", 0x00\n" "je .endwhile_" + labelnum + '\n';
+  currentScope->code.label(label(LabelKind::BeginWhile, labelnum));
+  compileFormula(whilestat.condition);
+  emit(Opcode::Cmp, reg(NAT_AX), hex(0));
+  emit(Opcode::Je, label(LabelKind::EndWhile, labelnum));
 
-  if(whilestat->statement->type == NodeType::Statements)
-    compileStatements(static_cast<StatementsNode*>(whilestat->statement));
+  if(whilestat.statement.type() == NodeType::Statements)
+    compileStatements(whilestat.statement);
   else
-    compileStatement(whilestat->statement);
+    compileStatement(whilestat.statement);
 
-  currentScope->text +=
-    "jmp .beginwhile_" + labelnum + "\n "
-    ".endwhile_" + labelnum +  ":\n";
+  emit(Opcode::Jmp, label(LabelKind::BeginWhile, labelnum));
+  currentScope->code.label(label(LabelKind::EndWhile, labelnum));
 }
 
-void NonsenseCompiler::compileForStatement(AST::CycleStatementNode *forstat) {
-  string labelnum = to_string((intptr_t)forstat);
-  ParametersNode *args = static_cast<ParametersNode*>(forstat->condition);
+void NonsenseCompiler::compileForStatement(const AST::CycleStatementNode &forstat) {
+  int64_t labelnum = ++currentScope->labelCount;
+  NodeList args = tree->parameters(forstat.condition).parameters;
 
-  compileFormula(args->parameters[0]);
-  currentScope->text += ".beginfor_" + labelnum + ":\n";
-  compileFormula(args->parameters[1]);
-  currentScope->text += "cmp " NAT_AX ", 0x00\n" "je .endfor_" + labelnum + '\n';
+  compileFormula(args[0]);
+  currentScope->code.label(label(LabelKind::BeginFor, labelnum));
+  compileFormula(args[1]);
+  emit(Opcode::Cmp, reg(NAT_AX), hex(0));
+  emit(Opcode::Je, label(LabelKind::EndFor, labelnum));
 
-  if(forstat->statement->type == NodeType::Statements)
-    compileStatements(static_cast<StatementsNode*>(forstat->statement));
+  if(forstat.statement.type() == NodeType::Statements)
+    compileStatements(forstat.statement);
   else
-    compileStatement(forstat->statement);
+    compileStatement(forstat.statement);
 
-  compileFormula(args->parameters[2]);
-  currentScope->text +=
-    "jmp .beginfor_" + labelnum + "\n "
-    ".endfor_" + labelnum +  ":\n";
+  compileFormula(args[2]);
+  emit(Opcode::Jmp, label(LabelKind::BeginFor, labelnum));
+  currentScope->code.label(label(LabelKind::EndFor, labelnum));
 }
 
-void NonsenseCompiler::compileUnary(AST::UnaryNode *unr) {
-  if(unr->node->type == NodeType::Parameters) {
+void NonsenseCompiler::compileUnary(AST::UnaryNode &unr) {
+  if(unr.node.type() == NodeType::Parameters) {
     compileCall(unr);
     return;
   }
 
-  Type presetType = unr->exprType;
-
-  switch (unr->op.operatorType) {
+  switch (unr.op.operatorType) {
   case Lexer::OperatorType::HardArrowRight:
-    compileFormula(unr->node);
-    currentScope->text += "mov " NAT_SP ", " NAT_BP "\n" "pop " NAT_BP "\n" "ret\n";
+    compileFormula(unr.node);
+    emit(Opcode::Mov, reg(NAT_SP), reg(NAT_BP));
+    emit(Opcode::Pop, reg(NAT_BP));
+    emit(Opcode::Ret);
     break;
 
   case Lexer::OperatorType::BinAnd:
-    if(!isVariable(unr->node))
-      throw Error(unr->begin, "Can't take adress of expression");
-
-    unr->exprType = unr->node->exprType;
-    compileVariableAddress(static_cast<ValueNode*>(unr->node));
-    unr->exprType.isPointer = true;
-    ++unr->exprType.pointerLevel;
-
-    if(!presetType.isNull())
-      unr->exprType = presetType;
-
+    compileVariableAddress(tree->value(unr.node));
     break;
 
   case Lexer::OperatorType::At: {
-    compileFormula(unr->node);
-
-    unr->exprType = unr->node->exprType;
-    AssemblerType exprasmtype;
+    compileFormula(unr.node);
 
-    if(unr->exprType.pointerLevel == 0) {
-      throw Error(unr->begin, "Indirection requires pointer operand");
-    }
-
-    if(unr->exprType.pointerLevel != 1)
-      exprasmtype = NAT_ASMTYPE;
-    else
-      exprasmtype = typesMap.find(unr->node->exprType.type)->second;
+    const Type &operandType = tree->exprType(unr.node);
+    const AssemblerType &exprasmtype = operandType.pointerLevel != 1
+      ? NAT_ASMTYPE
+      : asmType(operandType.base);
 
-    if(exprasmtype.asmname == NAT_TYPE)
-      currentScope->text += "mov " NAT_AX ", " + exprasmtype.asmname + "[" NAT_AX "]\n";
+    if(exprasmtype.width == NAT_TYPE)
+      emit(Opcode::Mov, reg(NAT_AX), mem(exprasmtype.width, NAT_AX));
     else
-      currentScope->text += "movzx " NAT_AX ", " + exprasmtype.asmname + "[" NAT_AX "]\n";
-
-    --unr->exprType.pointerLevel;
-
-    if(!presetType.isNull())
-      unr->exprType = presetType;
+      emit(Opcode::Movzx, reg(NAT_AX), mem(exprasmtype.width, NAT_AX));
 
     break;
   }
 
   default:
-      throw Error(unr->op, "Unknown unary operator");
+    break;
   }
 }
 
-void NonsenseCompiler::compileFormula(AST::Node *val) {
-  switch (val->type) {
+void NonsenseCompiler::compileFormula(AST::NodeId val) {
+  switch (val.type()) {
   case NodeType::BinaryOperator:
-    compileBinary(static_cast<BinaryNode*>(val));
+    compileBinary(tree->binary(val));
     break;
 
   case NodeType::UnaryOperator:
-    compileUnary(static_cast<UnaryNode*>(val));
+    compileUnary(tree->unary(val));
     break;
 
   case NodeType::Value:
-    compileValue(static_cast<ValueNode*>(val));
+    compileValue(tree->value(val));
     break;
 
   default:
-    throw Error(val->begin, "Not implemented #5");
+    break;
   }
 }
 
-void NonsenseCompiler::compileVariableDeclaration(AST::VariableNode *varNode) {
-  if(typesMap.find(varNode->varTypeToken.value) == typesMap.end())
-    throw Error(varNode->varTypeToken, "Unknown variable type");
-
-  Variable &var = currentScope->addVariable(varNode, typesMap[varNode->varTypeToken.value]);
-
+void NonsenseCompiler::compileVariableDeclaration(AST::VariableNode &varNode) {
+  // Locals are declared by the analysis
   if(currentScope != &global) {
-    if(var.variableType == VariableType::StaticArray && var.node->body != nullptr) {
-      if(varNode->body != nullptr)
-        throw Error(varNode->body->begin, "Can't initialize array [Not implemented]");
+    Variable &var = *varNode.variable;
+
+    // An array with an initializer is refused by the analysis
+    bool initializedArray = var.variableType == VariableType::StaticArray && var.node->body;
 
-    } else if(varNode->body != nullptr) {
-      compileFormula(varNode->body);
+    if(!initializedArray && varNode.body) {
+      compileFormula(varNode.body);
 
-      currentScope->text +=
-        "mov " + var.asmtype.asmname + "[" NAT_BP "-" + to_string(var.stackOffset) + "], " +
-        var.asmtype.baseRegs[0] + '\n';
+      emit(Opcode::Mov, local(var), reg(var.asmtype->baseRegs[0]));
     }
 
     return;
   }
 
-  if(varNode->body != nullptr && varNode->body->type != NodeType::Value)
-    throw Error(varNode->body->begin, "Global variable initializer isn't constant");
+  if(varNode.exprType.base == TypeId::Unknown)
+    throw Error(varNode.varTypeToken, "Unknown variable type");
+
+  Variable &var = global.addVariable(value(varNode.name), *tree, &varNode, asmType(varNode.exprType.base));
+  varNode.variable = &var;
 
-  if(varNode->body != nullptr) {
-    auto &val = static_cast<ValueNode*>(varNode->body)->value;
+  if(varNode.body && varNode.body.type() != NodeType::Value)
+    throw Error(tree->begin(varNode.body), "Global variable initializer isn't constant");
+
+  if(varNode.body) {
+    auto &val = tree->value(varNode.body).value;
 
     if(val.type == Lexer::Type::String) {
-      global.stringLiterals.push_back(val.value);
+      global.stringLiterals.push_back(Lexer::decodeString(value(val)));
 
-      var.initializer = "__string_literal_" + to_string(global.stringLiterals.size());
+      var.initializer = stringLiteralLabel(global, global.stringLiterals.size());
+    } else if(val.type == Lexer::Type::Char) {
+      var.initializer = to_string(val.integer) + ", 0x00";
     } else {
-      var.initializer = static_cast<ValueNode*>(varNode->body)->value.value;
+      var.initializer = string(value(val));
     }
   }
 }
 
-void NonsenseCompiler::compileCycleStatement(AST::CycleStatementNode *node) {
-  if(node->condition->type == NodeType::Parameters)
+void NonsenseCompiler::compileCycleStatement(const AST::CycleStatementNode &node) {
+  if(node.condition.type() == NodeType::Parameters)
     compileForStatement(node);
   else
     compileWhileStatement(node);
 }
 
-void NonsenseCompiler::compileStatement(AST::Node *stmt) {
-    switch (stmt->type) {
+void NonsenseCompiler::compileStatement(AST::NodeId stmt) {
+    switch (stmt.type()) {
     case NodeType::UnaryOperator:
-      if(static_cast<UnaryNode*>(stmt)->op.value == "asm")
-        compileAsmIncluding(static_cast<ParametersNode*>(static_cast<UnaryNode*>(stmt)->node));
+      if(value(tree->unary(stmt).op) == "asm")
+        compileAsmIncluding(tree->unary(stmt).node);
       else
         compileFormula(stmt);
 
@@ -667,166 +541,706 @@ void NonsenseCompiler::compileStatement(AST::Node *stmt) {
       compileFormula(stmt);
       break;
     case NodeType::Variable:
-      compileVariableDeclaration(static_cast<VariableNode*>(stmt));
+      compileVariableDeclaration(tree->variable(stmt));
       break;
     case NodeType::IfStatement:
-      compileIfStatement(static_cast<IfStatementNode*>(stmt));
+      compileIfStatement(tree->ifStatement(stmt));
       break;
     case NodeType::WhileStatement:
-      compileCycleStatement(static_cast<CycleStatementNode*>(stmt));
+      compileCycleStatement(tree->cycleStatement(stmt));
       break;
     default:
-      throw Error(stmt->begin, "Not implemented #3");
+      break;
     }
 }
 
-void NonsenseCompiler::compileStatements(AST::StatementsNode *stmts) {
-  for(auto i : stmts->statements)
+void NonsenseCompiler::compileStatements(AST::NodeId stmts) {
+  for(auto i : tree->statements(stmts).statements) {
     compileStatement(i);
+
+    if(currentScope->code.pending() >= PRINT_THRESHOLD)
+      lowerFinishedBlocks(*static_cast<Function*>(currentScope));
+  }
+}
+
+// Prints or encodes blocks [first, last) of the function
+void NonsenseCompiler::lowerBlocks(Function &func, size_t first, size_t last) {
+  if(module->format == Output::Assembly) {
+    MIR::print(func.code, first, last, source, value(func.node->name), func.text);
+    return;
+  }
+
+  try {
+    func.machineCode.encode(func.code, first, last, source);
+  } catch(MIR::EncodeError &e) {
+    throw Error(func.node->name, e.what());
+  }
+}
+
+// Long functions are lowered as they are compiled, so their IR never
+// outgrows their text
+void NonsenseCompiler::lowerFinishedBlocks(Function &func) {
+  size_t finished = func.code.finishedBlocks();
+
+  if(finished <= func.printedBlocks)
+    return;
+
+  lowerBlocks(func, func.printedBlocks, finished);
+  func.code.release(func.printedBlocks, finished);
+  func.printedBlocks = finished;
 }
 
-void NonsenseCompiler::compileFunctionDeclaration(FunctionNode *funcNode) {
-  Function func(funcNode);
+void NonsenseCompiler::compileFunctionDeclaration(Function &func) {
   currentScope = &func;
-  auto &parameters = static_cast<ParametersNode*>(func.node->parameters)->parameters;
+  NodeList parameters = tree->parameters(func.node->parameters).parameters;
 
   Variable *var = nullptr;
 
-  if(parameters.size() > sizeof(parametersRegList) / sizeof(string))
+  if(parameters.size() > std::size(parametersRegList))
     throw Error(func.node->begin, "Too many function parameters(more than 6)");
 
+  func.code.label(symbol(func.node->name));
+  emit(Opcode::Push, reg(NAT_BP));
+  emit(Opcode::Mov, reg(NAT_BP), reg(NAT_SP));
+
+  // The frame size is only known once the body is compiled
+  MIR::Code::Position frame = emit(Opcode::Nop);
+
   for(size_t i = 0; i < parameters.size(); ++i) {
-    auto parameter = static_cast<VariableNode*>(parameters[i]);
+    VariableNode &parameter = tree->variable(parameters[i]);
 
-    if(typesMap.find(parameter->varTypeToken.value) != typesMap.end())
-      var = &func.addVariable(parameter, typesMap[parameter->varTypeToken.value]);
+    if(parameter.exprType.base != TypeId::Unknown)
+      var = &func.addVariable(value(parameter.name), *tree, &parameter, asmType(parameter.exprType.base));
     else
-      throw Error(parameter->varTypeToken, "Unknown variable type");
+      throw Error(parameter.varTypeToken, "Unknown variable type");
 
-    if(var->asmtype.asmname == NAT_TYPE)
-      func.text +=
-        "mov " + var->asmtype.asmname + "[" NAT_BP "-" + to_string(var->stackOffset) + "], " +
-        parametersRegList[i] + '\n';
-    else
-      func.text +=
-        "mov " NAT_AX ", " + parametersRegList[i] + "\n"
-        "mov " + var->asmtype.asmname + "[" NAT_BP "-" + to_string(var->stackOffset) + "], " +
-        var->asmtype.baseRegs[0] + '\n';
+    if(var->asmtype->width == NAT_TYPE)
+      emit(Opcode::Mov, local(*var), reg(parametersRegList[i]));
+    else {
+      emit(Opcode::Mov, reg(NAT_AX), reg(parametersRegList[i]));
+      emit(Opcode::Mov, local(*var), reg(var->asmtype->baseRegs[0]));
+    }
   }
 
-  if(func.node->body == nullptr) {
-    func.text.clear();
-    global.functions.insert({ func.node->name.value, func });
+  if(!func.node->body) {
+    func.code.clear();
 
     return;
   }
 
-  if(func.node->body->type == NodeType::Statements)
-    compileStatements(static_cast<StatementsNode*>(func.node->body));
+  auto analysisStart = std::chrono::steady_clock::now();
+
+  Semantic::Analyzer(source, global, func, module->format == Output::Assembly).analyze();
+  module->analysisTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - analysisStart).count();
+
+  if(func.node->body.type() == NodeType::Statements)
+    compileStatements(func.node->body);
   else
     compileFormula(func.node->body);
 
-  func.text +=
-    "mov " NAT_SP ", " NAT_BP "\n"
-    "pop " NAT_BP "\n"
-    "ret\n";
+  emit(Opcode::Mov, reg(NAT_SP), reg(NAT_BP));
+  emit(Opcode::Pop, reg(NAT_BP));
+  emit(Opcode::Ret);
+
+  if(func.variablesOffset != 0)
+    func.code.at(frame) = { Opcode::Sub, { reg(NAT_SP), imm(static_cast<int64_t>(func.variablesOffset)) } };
+
+  if(module->format != Output::Assembly) {
+    lowerBlocks(func, func.printedBlocks, func.code.getBlocks().size());
+    lowerBlocks(func, 0, 1);
+
+    try {
+      func.machineCode.finish();
+    } catch(MIR::EncodeError &e) {
+      throw Error(func.node->name, e.what());
+    }
+  } else if(func.printedBlocks == 1) {
+    MIR::print(func.code, source, value(func.node->name), func.text);
+  } else {
+    OutputBuffer text;
+    size_t blocks = func.code.getBlocks().size();
+
+    MIR::print(func.code, 0, 1, source, value(func.node->name), text);
+    text << std::move(func.text);
+    MIR::print(func.code, func.printedBlocks, blocks, source, value(func.node->name), text);
+
+    func.text = std::move(text);
+  }
+
+  func.code.clear();
+}
+
+// Functions are only registered here, their bodies are compiled once every
+// global declaration is known. Returns false for a name that is already
+// taken, whose declaration is then ignored.
+bool NonsenseCompiler::declareStatement(AST::NodeId stmt) {
+  currentScope = static_cast<Scope*>(&global);
+
+  switch (stmt.type()) {
+  case NodeType::Function: {
+    FunctionNode &funcNode = tree->function(stmt);
+    auto inserted = global.functions.try_emplace(value(funcNode.name), *tree, &funcNode);
+
+    if(inserted.second)
+      functions.push_back(&inserted.first->second);
+
+    return inserted.second;
+  }
+
+  case NodeType::Variable: {
+    VariableNode &varNode = tree->variable(stmt);
+    compileVariableDeclaration(varNode);
+
+    Variable &var = *varNode.variable;
+
+    if(var.node != &varNode)
+      return false;
+
+    variables.push_back(&var);
+
+    return true;
+  }
+
+  default:
+    throw Error(tree->begin(stmt), "Expected function or variable declaration");
+  }
+}
+
+// Each function gets a compiler of its own that shares the module. Errors
+// are reported for the first function in the source that has one, however
+// the tasks happened to run.
+string_view NonsenseCompiler::declarationText(uint32_t begin) {
+  auto &begins = module->declarationBegins;
+  auto next = upper_bound(begins.begin(), begins.end(), begin);
+  size_t end = next == begins.end() ? source.size() : *next;
+
+  return source.substr(begin, end - begin);
+}
+
+// The code of a function depends on its own text and on the declarations
+// of the globals it refers to, but not on the bodies of the functions it
+// calls. Every global name in its text is taken as a reference.
+string NonsenseCompiler::cacheKey(const Function &func) {
+  string_view text = declarationText(func.node->begin);
+  string key = to_string(static_cast<int>(module->format)) + '\n';
+  unordered_set<string_view> names;
+
+  key += text;
+
+  for(size_t i = 0; i < text.size();) {
+    size_t end = i;
+
+    while(end < text.size() && (isalnum(static_cast<unsigned char>(text[end])) || text[end] == '_'))
+      ++end;
+
+    if(end == i) {
+      ++i;
+      continue;
+    }
+
+    string_view name = text.substr(i, end - i);
+    i = end;
 
-  currentScope->text.insert(
-    0,
-    func.node->name.value + ":\n"
-    "push " NAT_BP "\n"
-    "mov " NAT_BP ", " NAT_SP "\n" +
-    (func.variablesOffset != 0 ? "sub " NAT_SP ", " + to_string(func.variablesOffset) + '\n' : ""));
+    if(isdigit(static_cast<unsigned char>(name[0])) || !names.insert(name).second)
+      continue;
 
-  global.functions.insert({funcNode->name.value, func});
+    auto callee = global.functions.find(name);
+
+    // A signature ends with the return type
+    if(callee != global.functions.end() && &callee->second != &func) {
+      auto &node = *callee->second.node;
+
+      key += '\0';
+      key += source.substr(node.begin, node.varTypeToken.offset + node.varTypeToken.size() - node.begin);
+    }
+
+    auto var = global.variables.find(name);
+
+    if(var != global.variables.end()) {
+      key += '\0';
+      key += declarationText(var->second.node->begin);
+    }
+  }
+
+  return key;
+}
+
+static void putNumber(string &entry, uint64_t number) {
+  entry.append(reinterpret_cast<const char*>(&number), sizeof(number));
+}
+
+static bool getNumber(string_view &entry, uint64_t &number) {
+  if(entry.size() < sizeof(number))
+    return false;
+
+  memcpy(&number, entry.data(), sizeof(number));
+  entry.remove_prefix(sizeof(number));
+  return true;
+}
+
+static bool getText(string_view &entry, string_view &text) {
+  uint64_t size;
+
+  if(!getNumber(entry, size) || entry.size() < size)
+    return false;
+
+  text = entry.substr(0, size);
+  entry.remove_prefix(size);
+  return true;
+}
+
+// An entry is the string literals of the function, then its text, or its
+// machine code and relocations. Symbols of relocations are kept by name and
+// pointed at the declaration of that name when loaded.
+bool NonsenseCompiler::loadCached(Function &func, const string &key) {
+  auto cached = module->cache->load(key);
+
+  if(!cached)
+    return false;
+
+  string_view entry = *cached;
+  string_view text;
+  uint64_t count;
+
+  if(!getNumber(entry, count))
+    return false;
+
+  for(uint64_t i = 0; i < count; ++i) {
+    if(!getText(entry, text))
+      return false;
+
+    func.stringLiterals.emplace_back(text);
+  }
+
+  if(module->format == Output::Assembly) {
+    func.text << entry;
+    return true;
+  }
+
+  if(!getText(entry, text) || !getNumber(entry, count))
+    return false;
+
+  func.machineCode.bytes.assign(text.begin(), text.end());
+
+  for(uint64_t i = 0; i < count; ++i) {
+    uint64_t offset, type, kind, addend;
+
+    if(!getNumber(entry, offset) || !getNumber(entry, type) || !getNumber(entry, kind) || !getNumber(entry, addend))
+      return false;
+
+    Relocation relocation{ offset, static_cast<RelocationType>(type), Operand(), static_cast<int64_t>(addend) };
+    relocation.target.kind = static_cast<Operand::Kind>(kind);
+
+    if(relocation.target.kind == Operand::Kind::StringLiteral) {
+      uint64_t number;
+
+      if(!getNumber(entry, number))
+        return false;
+
+      relocation.target.value = static_cast<int64_t>(number);
+    } else {
+      if(!getText(entry, text))
+        return false;
+
+      auto var = global.variables.find(text);
+      auto callee = global.functions.find(text);
+
+      if(var == global.variables.end() && callee == global.functions.end())
+        return false;
+
+      const Lexer::Token &name = var != global.variables.end() ? var->second.node->name : callee->second.node->name;
+      relocation.target.length = static_cast<uint32_t>(name.size());
+      relocation.target.value = static_cast<int64_t>(name.offset);
+    }
+
+    func.machineCode.relocations.push_back(relocation);
+  }
+
+  return true;
 }
 
-string NonsenseCompiler::convertStringToNumbers(string str) {
-  string nums;
+void NonsenseCompiler::storeCached(Function &func, const string &key) {
+  string entry;
 
-  for(char i : str) {
-    nums += to_string(static_cast<int>(i)) + ", ";
+  putNumber(entry, func.stringLiterals.size());
+
+  for(auto &i : func.stringLiterals) {
+    putNumber(entry, i.size());
+    entry += i;
   }
 
-  nums.pop_back();
-  nums.pop_back();
+  if(module->format == Output::Assembly) {
+    func.text.appendTo(entry);
+    module->cache->store(key, std::move(entry));
+    return;
+  }
+
+  auto &bytes = func.machineCode.bytes;
+
+  putNumber(entry, bytes.size());
+  entry.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+  putNumber(entry, func.machineCode.relocations.size());
+
+  for(auto &relocation : func.machineCode.relocations) {
+    putNumber(entry, relocation.offset);
+    putNumber(entry, static_cast<uint64_t>(relocation.type));
+    putNumber(entry, static_cast<uint64_t>(relocation.target.kind));
+    putNumber(entry, static_cast<uint64_t>(relocation.addend));
+
+    if(relocation.target.kind == Operand::Kind::StringLiteral) {
+      putNumber(entry, static_cast<uint64_t>(relocation.target.value));
+    } else {
+      string_view name = source.substr(static_cast<size_t>(relocation.target.value), relocation.target.length);
 
-  return nums;
+      putNumber(entry, name.size());
+      entry += name;
+    }
+  }
+
+  module->cache->store(key, std::move(entry));
+}
+
+void NonsenseCompiler::compileFunctions(ThreadPool *pool) {
+  vector<exception_ptr> errors(functions.size());
+
+  auto compile = [this, &errors](size_t i) {
+    Function &func = *functions[i];
+
+    try {
+      if(!module->cache || !func.node->body) {
+        NonsenseCompiler(*this, func);
+        return;
+      }
+
+      string key = cacheKey(func);
+
+      if(loadCached(func, key))
+        return;
+
+      NonsenseCompiler(*this, func);
+      storeCached(func, key);
+    } catch(...) {
+      errors[i] = current_exception();
+    }
+  };
+
+  if(pool && pool->size() > 1) {
+    TaskGroup group(*pool);
+
+    for(size_t i = 0; i < functions.size(); ++i)
+      group.run([&compile, i]() { compile(i); });
+
+    group.wait();
+  } else {
+    for(size_t i = 0; i < functions.size(); ++i)
+      compile(i);
+  }
+
+  for(auto &i : errors)
+    if(i)
+      rethrow_exception(i);
+}
+
+string_view NonsenseCompiler::value(const Lexer::Token &tok) {
+  return tok.value(source);
+}
+
+string NonsenseCompiler::stringLiteralLabel(const Scope &scope, size_t number) {
+  if(&scope == &global)
+    return "__string_literal_" + to_string(number);
+
+  return "__string_literal_" + string(value(static_cast<const Function&>(scope).node->name)) +
+    '_' + to_string(number);
+}
+
+void NonsenseCompiler::writeDataSections(OutputBuffer &code) {
+  code << "section .data\n";
+
+  vector<const Scope*> scopes = { &global };
+  scopes.insert(scopes.end(), functions.begin(), functions.end());
+
+  for(auto scope : scopes) {
+    for(size_t i = 0; i < scope->stringLiterals.size(); ++i) {
+      code << stringLiteralLabel(*scope, i + 1) << " db ";
+
+      for(char ch : scope->stringLiterals[i])
+        code << static_cast<int>(ch) << ", ";
+
+      code << "0x00\n";
+    }
+  }
+
+  for(auto i : variables) {
+    if(!i->initializer.empty()) {
+      code << value(i->node->name) << ' ' << DATA_DIRECTIVES[static_cast<size_t>(i->asmtype->width)] <<
+        ' ' << i->initializer << '\n';
+    }
+  }
+
+  code << "section .bss\n";
+
+  for(auto i : variables)
+    if(i->initializer.empty() && (!i->node->isExtern || i->node->isDefined))
+      code << value(i->node->name) << " resb " <<
+        (i->variableType == VariableType::StaticArray
+         ? i->arraySizeInBytes
+         : i->asmtype->size) << '\n';
 }
 
 void NonsenseCompiler::finalAssembly() {
-  asmCode += "section .text\n";
-  asmCode += global.functions.find("_start") != global.functions.end() ? "global _start\n" : "";
-  asmCode += global.text;
+  output << "section .text\n";
 
-  for(auto &i : global.functions) {
-    if(i.second.node->isExtern)
-      asmCode += "extern " + i.second.node->name.value + '\n';
+  if(global.functions.find("_start") != global.functions.end())
+    output << "global _start\n";
+
+  output << std::move(global.text);
+
+  for(auto i : functions) {
+    if(i->node->isExtern)
+      output << "extern " << value(i->node->name) << '\n';
   }
 
-  for(auto i : global.variables) {
-    if(i.second.node->isExtern)
-      asmCode += "extern " + i.second.node->name.value + '\n';
+  for(auto i : variables) {
+    if(i->node->isExtern)
+      output << "extern " << value(i->node->name) << '\n';
   }
 
-  for(auto &i : global.functions) {
-    asmCode += i.second.text;
+  for(auto i : functions) {
+    output << std::move(i->text);
   }
 
-  asmCode += "section .data\n";
+  writeDataSections(output);
+}
+
+// A number of a data definition, in NASM syntax
+static uint64_t dataNumber(string_view text) {
+  uint64_t number = 0;
+
+  if(text.substr(0, 2) == "0x")
+    from_chars(text.data() + 2, text.data() + text.size(), number, 16);
+  else
+    from_chars(text.data(), text.data() + text.size(), number);
+
+  return number;
+}
+
+// The object file NASM makes of finalAssembly(). A function that isn't
+// static is both extern and defined there, which NASM makes global.
+void NonsenseCompiler::finalObject() {
+  unordered_map<string, size_t> symbols;
+  vector<uint64_t> functionOffsets(functions.size());
+
+  auto define = [&](const string &name, ELF::Section section, uint64_t offset, bool isGlobal) {
+    symbols[name] = object.addSymbol(name, section, offset, isGlobal);
+  };
+
+  for(size_t i = 0; i < functions.size(); ++i) {
+    Function &func = *functions[i];
+    string name(value(func.node->name));
+
+    if(!func.node->body) {
+      define(name, ELF::Section::Undefined, 0, true);
+      continue;
+    }
+
+    functionOffsets[i] = object.text.size();
+    define(name, ELF::Section::Text, object.text.size(), func.node->isExtern || name == "_start");
+    object.text.insert(object.text.end(), func.machineCode.bytes.begin(), func.machineCode.bytes.end());
+    vector<uint8_t>().swap(func.machineCode.bytes);
+  }
+
+  vector<const Scope*> scopes = { &global };
+  scopes.insert(scopes.end(), functions.begin(), functions.end());
+
+  for(auto scope : scopes) {
+    for(size_t i = 0; i < scope->stringLiterals.size(); ++i) {
+      define(stringLiteralLabel(*scope, i + 1), ELF::Section::Data, object.data.size(), false);
+      object.data.insert(object.data.end(), scope->stringLiterals[i].begin(), scope->stringLiterals[i].end());
+      object.data.push_back(0);
+    }
+  }
+
+  // Initializers are lists of numbers and symbols; the addresses of the
+  // symbols are filled in once all of them are defined
+  vector<tuple<Variable*, uint64_t, string>> addresses;
+
+  for(auto i : variables) {
+    if(i->initializer.empty())
+      continue;
+
+    define(string(value(i->node->name)), ELF::Section::Data, object.data.size(), i->node->isExtern);
+
+    for(size_t begin = 0; begin < i->initializer.size();) {
+      size_t end = min(i->initializer.find(',', begin), i->initializer.size());
+      string_view item = string_view(i->initializer).substr(begin, end - begin);
+
+      item.remove_prefix(min(item.find_first_not_of(' '), item.size()));
+      begin = end + 1;
+
+      uint64_t number = 0;
+
+      if(isdigit(static_cast<unsigned char>(item[0])))
+        number = dataNumber(item);
+      else
+        addresses.emplace_back(i, object.data.size(), string(item));
+
+      for(size_t byte = 0; byte < i->asmtype->size; ++byte)
+        object.data.push_back(static_cast<uint8_t>(number >> (byte * 8)));
+    }
+  }
+
+  for(auto i : variables) {
+    if(!i->initializer.empty())
+      continue;
+
+    if(i->node->isExtern && !i->node->isDefined) {
+      define(string(value(i->node->name)), ELF::Section::Undefined, 0, true);
+      continue;
+    }
+
+    define(string(value(i->node->name)), ELF::Section::Bss, object.bssSize, i->node->isExtern);
+    object.bssSize += i->variableType == VariableType::StaticArray ? i->arraySizeInBytes : i->asmtype->size;
+  }
 
-  for(size_t i = 0; i < global.stringLiterals.size(); ++i)
-    asmCode +=
-      "__string_literal_" + to_string(i + 1) + " db " +
-      convertStringToNumbers(global.stringLiterals[i].substr(1, global.stringLiterals[i].size() - 2)) + ", 0x00\n";
+  for(auto &[var, offset, name] : addresses) {
+    auto symbol = symbols.find(name);
 
-  for(auto &i : global.variables) {
-    if(!i.second.initializer.empty()) {
-      if(i.second.initializer[0] == '"') {
-        asmCode += i.second.node->name.value + ' ' + TYPES_RES_LABELS[i.second.asmtype.asmname].first +
-          ' ' + convertStringToNumbers(i.second.initializer.substr(1, i.second.initializer.size() - 2)) + ", 0x00\n";
-      } else if(i.second.initializer[0] == '\'') {
-        asmCode += i.second.node->name.value + ' ' + TYPES_RES_LABELS[i.second.asmtype.asmname].first +
-          ' ' + to_string(static_cast<int>(i.second.initializer[1])) + ", 0x00\n";
+    if(symbol == symbols.end())
+      throw Error(var->node->name, "Undefined symbol '" + name + "'");
+
+    if(var->asmtype->size != 8 && var->asmtype->size != 4)
+      throw Error(var->node->name, "Variable can't hold an address");
+
+    object.addRelocation(ELF::Section::Data, offset,
+                         var->asmtype->size == 8 ? RelocationType::Abs64 : RelocationType::Abs32, symbol->second, 0);
+  }
+
+  for(size_t i = 0; i < functions.size(); ++i) {
+    Function &func = *functions[i];
+
+    for(auto &relocation : func.machineCode.relocations) {
+      string name = relocation.target.kind == Operand::Kind::StringLiteral
+        ? stringLiteralLabel(func, static_cast<size_t>(relocation.target.value))
+        : string(source.substr(static_cast<size_t>(relocation.target.value), relocation.target.length));
+      auto symbol = symbols.find(name);
+
+      if(symbol == symbols.end())
+        throw Error(func.node->name, "Undefined symbol '" + name + "'");
+
+      const ELF::Symbol &target = object.symbols[symbol->second];
+      uint64_t offset = functionOffsets[i] + relocation.offset;
+
+      // Calls within the file are resolved here
+      if(relocation.type == RelocationType::Pc32 && target.section == ELF::Section::Text) {
+        auto distance = static_cast<uint64_t>(static_cast<int64_t>(target.value - offset) + relocation.addend);
+
+        for(size_t byte = 0; byte < 4; ++byte)
+          object.text[offset + byte] = static_cast<uint8_t>(distance >> (byte * 8));
       } else {
-        asmCode += i.second.node->name.value + ' ' + TYPES_RES_LABELS[i.second.asmtype.asmname].first +
-          ' ' + i.second.initializer + '\n';
+        object.addRelocation(ELF::Section::Text, offset, relocation.type, symbol->second, relocation.addend);
       }
     }
+
+    vector<Relocation>().swap(func.machineCode.relocations);
+  }
+
+  if(module->format == Output::Object)
+    object.write(output);
+}
+
+NonsenseCompiler::NonsenseCompiler(Tree &tree_, NodeList declarations, string_view source_, ThreadPool *pool,
+                                   Output format, Cache::Cache *cache, TimeReport::Report *report)
+    : source(source_), module(make_shared<Module>()), global(module->global), tree(&tree_),
+      currentScope(static_cast<Scope *>(&global)), stream(nullptr) {
+  module->format = format;
+  module->cache = cache;
+
+  if(cache)
+    for(auto i : declarations)
+      module->declarationBegins.push_back(tree->begin(i));
+
+  // A bad declaration is reported after the errors of the functions
+  // before it, as if everything was compiled in order
+  exception_ptr declarationError;
+
+  for(auto i : declarations) {
+    try {
+      declareStatement(i);
+    } catch(...) {
+      declarationError = current_exception();
+      break;
+    }
   }
 
-  asmCode += "section .bss\n";
+  compileFunctions(pool);
+
+  if(declarationError)
+    rethrow_exception(declarationError);
+
+  if(report)
+    report->endPhase("codegen");
+
+  if(format != Output::Assembly)
+    finalObject();
+  else
+    finalAssembly();
+}
+
+NonsenseCompiler::NonsenseCompiler(const NonsenseCompiler &parent, Function &func)
+    : source(parent.source), module(parent.module), global(module->global), tree(func.tree),
+      currentScope(&func), stream(nullptr) {
+  compileFunctionDeclaration(func);
+}
 
-  for(auto &i : global.variables)
-    if(i.second.initializer.empty() && (!i.second.node->isExtern || i.second.node->isDefined))
-      asmCode += i.second.node->name.value + " resb " +
-        to_string(i.second.variableType == VariableType::StaticArray
-                  ? i.second.arraySizeInBytes
-                  : i.second.asmtype.size) + '\n';
+NonsenseCompiler::NonsenseCompiler(Tree &tree_, string_view source_, OutputBuffer &out)
+    : source(source_), module(make_shared<Module>()), global(module->global), tree(&tree_),
+      currentScope(static_cast<Scope *>(&global)), stream(&out) {
+  *stream << "section .text\n";
 }
 
-NonsenseCompiler::NonsenseCompiler(StatementsNode &tree_)
-    : tree(tree_), currentScope(static_cast<Scope *>(&global)),
-      typesMap({ { "i64",   AssemblerType("qword", { "rax", "rbx", "rcx", "rbx"}, 8)},
-                 { "i32",   AssemblerType("dword", { "eax", "ebx", "ecx", "edx" }, 4) },
-                 { "byte",  AssemblerType("byte",  { "al", "bl" }, 1) },
-                 { "void",  AssemblerType("",      { "rax", "rbx", "rcx", "rdx" }, 0) }}) {
-  for(auto i : tree.statements) {
-    currentScope = static_cast<Scope*>(&global);
+// Whatever of the declaration is still needed later is copied out of its
+// tree: the signature of a function and the whole of a global variable
+void NonsenseCompiler::compileDeclaration(NodeId decl) {
+  if(!declareStatement(decl))
+    return;
 
-    switch (i->type) {
-    case NodeType::Function:
-      compileFunctionDeclaration(static_cast<FunctionNode*>(i));
-      break;
+  if(decl.type() == NodeType::Variable) {
+    Variable &var = *variables.back();
+    var.node = &module->declarations.variable(module->declarations.cloneDeclaration(*tree, decl));
 
-    case NodeType::Variable:
-      compileVariableDeclaration(static_cast<VariableNode*>(i));
-      break;
+    if(var.node->isExtern)
+      *stream << "extern " << value(var.node->name) << '\n';
 
-    default:
-      throw Error(i->begin, "Expected function or variable declaration");
-    }
+    return;
   }
 
-  finalAssembly();
+  Function &func = *functions.back();
+  compileFunctionDeclaration(func);
+  currentScope = static_cast<Scope*>(&global);
+
+  if(func.node->isExtern)
+    *stream << "extern " << value(func.node->name) << '\n';
+
+  if(value(func.node->name) == "_start")
+    *stream << "global _start\n";
+
+  *stream << std::move(global.text) << std::move(func.text);
+  decltype(func.variables)().swap(func.variables);
+
+  func.node = &module->declarations.function(module->declarations.cloneDeclaration(*tree, decl));
+  func.tree = &module->declarations;
+}
+
+void NonsenseCompiler::finish() {
+  *stream << std::move(global.text);
+  writeDataSections(*stream);
+}
+
+std::chrono::nanoseconds NonsenseCompiler::analysisTime() const {
+  return std::chrono::nanoseconds(module->analysisTime.load());
+}
+
+size_t NonsenseCompiler::functionCount() const {
+  return functions.size();
 }
@@ -0,0 +1,420 @@
+#include "driver.hpp"
+#include "codefile.hpp"
+#include "lexer.hpp"
+#include "token_stream.hpp"
+#include "parser.hpp"
+#include "compiler.hpp"
+#include "thread_pool.hpp"
+#include "output_buffer.hpp"
+#include "jit.hpp"
+#include "cache.hpp"
+#include "allocations.hpp"
+#include "time_report.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+// How much streamed code is gathered before it is written out
+static constexpr size_t STREAM_FLUSH_SIZE = 1 << 20;
+
+namespace Driver {
+  // The allocations of every phase and the time of the semantic analysis
+  static void printStats(const std::string &fileName, const TimeReport::Report &report,
+                         std::ostream &diagnostics) {
+    for(auto &phase : report.phases)
+      diagnostics << fileName << ": " << phase.name << ": " << phase.allocations.allocations << " allocations, "
+                  << phase.allocations.bytes << " bytes" << std::endl;
+
+    diagnostics << fileName << ": semantic analysis: "
+                << std::chrono::duration<double, std::milli>(report.analysis).count() << " ms" << std::endl;
+  }
+
+  static bool cantRead(const std::string &fileName, std::ostream &diagnostics) {
+    diagnostics << "Can't read '" << fileName << '\'' << std::endl;
+    return false;
+  }
+
+  // Reported without an excerpt, which would be the whole file
+  static bool tooLarge(const std::string &fileName, std::ostream &diagnostics) {
+    diagnostics << fileName << ": Source file is too large" << std::endl;
+    return false;
+  }
+
+  static bool writeFailed(const std::string &fileName, std::ostream &diagnostics) {
+    diagnostics << "Can't write the output of '" << fileName << '\'' << std::endl;
+    return false;
+  }
+
+  bool compile(const std::string &fileName, ThreadPool &pool, const Options &options,
+               int fd, std::ostream &diagnostics) {
+    // Only kept when something prints it
+    std::optional<TimeReport::Report> report;
+
+    if(options.printStats || options.timeReport)
+      report.emplace();
+
+    auto endPhase = [&report](const char *phase) {
+      if(report)
+        report->endPhase(phase);
+    };
+
+    CodeFile::CodeFile file(fileName);
+
+    if(!file.readable)
+      return cantRead(fileName, diagnostics);
+
+    if(file.tooLarge())
+      return tooLarge(fileName, diagnostics);
+
+    Lexer::Lexer lexer(file, &pool);
+    Lexer::TokenStream tokens(lexer);
+
+    endPhase("load");
+
+    try {
+      // The tokens are lexed as the parser asks for them, so lexing is
+      // part of parsing
+      Parser::Parser prs(tokens, file.fileData, !options.streaming);
+
+      if(options.streaming) {
+        OutputBuffer out;
+        Compiler::NonsenseCompiler comp(prs.tree, file.fileData, out);
+        size_t written = 0;
+
+        for(AST::NodeId decl; (decl = prs.parseDeclaration()); ) {
+          comp.compileDeclaration(decl);
+          prs.tree.reset();
+
+          if(out.size() >= STREAM_FLUSH_SIZE) {
+            written += out.size();
+
+            if(!out.writeTo(fd))
+              return writeFailed(fileName, diagnostics);
+          }
+        }
+
+        comp.finish();
+        endPhase("parse and codegen");
+        written += out.size();
+
+        if(!out.writeTo(fd))
+          return writeFailed(fileName, diagnostics);
+
+        endPhase("output");
+
+        if(report) {
+          report->analysis = comp.analysisTime();
+          report->functions = comp.functionCount();
+          report->outputBytes = written;
+        }
+      } else {
+        endPhase("parse");
+
+        Compiler::NonsenseCompiler comp(prs.tree, prs.stmts, file.fileData, &pool,
+                                        options.object ? Compiler::Output::Object : Compiler::Output::Assembly,
+                                        options.cache, report ? &*report : nullptr);
+        size_t written = comp.output.size();
+
+        if(!comp.output.writeTo(fd))
+          return writeFailed(fileName, diagnostics);
+
+        endPhase("output");
+
+        if(report) {
+          report->analysis = comp.analysisTime();
+          report->functions = comp.functionCount();
+          report->outputBytes = written;
+        }
+      }
+
+      if(report) {
+        report->sourceBytes = file.fileData.size();
+        report->tokens = tokens.count();
+        report->nodes = prs.tree.nodeCount();
+      }
+
+      if(options.printStats) {
+        printStats(fileName, *report, diagnostics);
+        diagnostics << fileName << ": AST arena: " << prs.tree.arena.allocationCount() << " allocations, "
+                    << prs.tree.arena.bytesAllocated() << " bytes in "
+                    << prs.tree.arena.blockCount() << " blocks" << std::endl;
+      }
+
+      if(options.timeReport)
+        report->print(diagnostics, fileName, options.timeReportJson);
+    } catch(Lexer::Error &e) {
+      lexer.printError(diagnostics, e.offset, e.error);
+      return false;
+    } catch(Parser::Error &e) {
+      lexer.printError(diagnostics, e.offset, e.error);
+      return false;
+    }
+
+    return true;
+  }
+
+  int run(const std::string &fileName, ThreadPool &pool, const Options &options, std::ostream &diagnostics) {
+    CodeFile::CodeFile file(fileName);
+
+    if(!file.readable) {
+      cantRead(fileName, diagnostics);
+      return 1;
+    }
+
+    if(file.tooLarge()) {
+      tooLarge(fileName, diagnostics);
+      return 1;
+    }
+
+    Lexer::Lexer lexer(file, &pool);
+    Lexer::TokenStream tokens(lexer);
+    std::unique_ptr<JIT::Image> image;
+
+    // The trees and the compiler are freed before the program runs
+    try {
+      Parser::Parser prs(tokens, file.fileData, true);
+      Compiler::NonsenseCompiler comp(prs.tree, prs.stmts, file.fileData, &pool, Compiler::Output::Memory,
+                                      options.cache);
+
+      image = std::make_unique<JIT::Image>(comp.object);
+    } catch(Lexer::Error &e) {
+      lexer.printError(diagnostics, e.offset, e.error);
+      return 1;
+    } catch(Parser::Error &e) {
+      lexer.printError(diagnostics, e.offset, e.error);
+      return 1;
+    } catch(JIT::Error &e) {
+      diagnostics << fileName << ": " << e.error << std::endl;
+      return 1;
+    }
+
+    if(options.perfMap && !image->writePerfMap())
+      diagnostics << "Can't write the perf map" << std::endl;
+
+    if(image->has("_start")) {
+      image->call("_start");
+      return 0;
+    }
+
+    if(image->has("main"))
+      return static_cast<int>(image->call("main"));
+
+    diagnostics << fileName << ": There's no _start or main to run" << std::endl;
+    return 1;
+  }
+
+  std::string outputName(const std::string &fileName, const Options &options) {
+    const char *extension = options.object ? ".o" : ".asm";
+    size_t slash = fileName.find_last_of('/');
+    size_t dot = fileName.find_last_of('.');
+
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      return fileName + extension;
+
+    return fileName.substr(0, dot) + extension;
+  }
+
+  bool readResponseFile(const std::string &fileName, std::vector<std::string> &files) {
+    std::ifstream list(fileName);
+    std::string name;
+
+    if(!list)
+      return false;
+
+    while(list >> name)
+      files.push_back(name);
+
+    return true;
+  }
+
+  bool compileBatch(const std::vector<std::string> &files, ThreadPool &pool, const Options &options,
+                    std::ostream &out) {
+    std::vector<std::ostringstream> diagnostics(files.size());
+    std::vector<char> succeeded(files.size(), false);
+
+    {
+      TaskGroup group(pool);
+
+      for(size_t i = 0; i < files.size(); ++i) {
+        // The output is written under a temporary name and renamed over
+        // the target only once the file has compiled, so an input that has
+        // the name of an output is read before it is replaced
+        group.run([&, i]() {
+          std::string output = outputName(files[i], options);
+          std::string temporary = output + '.' + std::to_string(getpid()) + '.' + std::to_string(i);
+          int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+          if(fd < 0) {
+            diagnostics[i] << "Can't write '" << output << '\'' << std::endl;
+            return;
+          }
+
+          succeeded[i] = compile(files[i], pool, options, fd, diagnostics[i]);
+
+          if(close(fd) != 0 && succeeded[i]) {
+            diagnostics[i] << "Can't write '" << output << '\'' << std::endl;
+            succeeded[i] = false;
+          }
+
+          if(succeeded[i] && rename(temporary.c_str(), output.c_str()) != 0) {
+            diagnostics[i] << "Can't write '" << output << '\'' << std::endl;
+            succeeded[i] = false;
+          }
+
+          if(!succeeded[i]) {
+            unlink(temporary.c_str());
+
+            // Nor is the output of an earlier compile, unless it is the input
+            if(output != files[i])
+              unlink(output.c_str());
+          }
+        });
+      }
+
+      group.wait();
+    }
+
+    bool ok = true;
+
+    for(size_t i = 0; i < files.size(); ++i) {
+      out << diagnostics[i].str();
+      ok = ok && succeeded[i];
+    }
+
+    return ok;
+  }
+
+  static std::string relativeTo(const std::string &directory, const std::string &fileName) {
+    if(directory.empty() || fileName.empty() || fileName[0] == '/')
+      return fileName;
+
+    return directory + '/' + fileName;
+  }
+
+  bool parseCommand(const std::vector<std::string> &args, const std::string &directory,
+                    Command &command, std::ostream &diagnostics) {
+    Options &options = command.options;
+
+    for(size_t i = 1; i < args.size(); ++i) {
+      const std::string &arg = args[i];
+
+      if(arg.compare(0, 2, "-j") == 0) {
+        std::string count = arg.size() > 2 ? arg.substr(2) : (i + 1 < args.size() ? args[++i] : "");
+        char *end = nullptr;
+        long value = std::strtol(count.c_str(), &end, 10);
+
+        if(end == count.c_str() || *end != '\0' || value < 1) {
+          diagnostics << "Invalid thread count '" << count << '\'' << std::endl;
+          return false;
+        }
+
+        command.threads = static_cast<size_t>(value);
+      } else if(arg == "--stats") {
+        options.printStats = true;
+      } else if(arg == "--time-report" || arg == "--time-report=json") {
+        options.timeReport = true;
+        options.timeReportJson = arg == "--time-report=json";
+      } else if(arg == "--stream") {
+        options.streaming = true;
+      } else if(arg == "-c") {
+        options.object = true;
+      } else if(arg == "--run") {
+        command.run = true;
+      } else if(arg == "--perf-map") {
+        options.perfMap = true;
+      } else if(arg == "--cache" || arg == "--server") {
+        if(i + 1 == args.size()) {
+          diagnostics << arg << " takes a " << (arg == "--cache" ? "directory" : "socket") << std::endl;
+          return false;
+        }
+
+        (arg == "--cache" ? command.cacheDirectory : command.server) = relativeTo(directory, args[++i]);
+      } else if(arg[0] == '@') {
+        size_t first = command.files.size();
+        std::string list = relativeTo(directory, arg.substr(1));
+
+        command.batch = true;
+
+        if(!readResponseFile(list, command.files)) {
+          diagnostics << "Can't read response file '" << list << '\'' << std::endl;
+          return false;
+        }
+
+        for(size_t file = first; file < command.files.size(); ++file)
+          command.files[file] = relativeTo(directory, command.files[file]);
+      } else {
+        command.files.push_back(relativeTo(directory, arg));
+      }
+    }
+
+    const std::string &name = args.empty() ? "nsspl" : args[0];
+
+    if(command.files.empty() && !command.batch && command.server.empty()) {
+      diagnostics << "Usage: " << name << " [-j threads] [--stats] [--time-report[=json]] [--stream] [--cache dir] file" << std::endl
+                  << "       " << name << " [-j threads] [--stats] [--time-report[=json]] [--stream] [--cache dir] file|@list..." << std::endl
+                  << "       " << name << " -c [-j threads] [--stats] [--time-report[=json]] [--cache dir] file|@list..." << std::endl
+                  << "       " << name << " --run [-j threads] [--perf-map] [--cache dir] file" << std::endl
+                  << "       " << name << " --server socket [-j threads] [--cache dir]" << std::endl
+                  << "       " << name << " --connect socket arguments..." << std::endl;
+      return false;
+    }
+
+    // Streamed functions are written as they are compiled, which leaves
+    // nothing to look up
+    if(!command.cacheDirectory.empty() && options.streaming) {
+      diagnostics << "--stream can't be used with --cache" << std::endl;
+      return false;
+    }
+
+    if(command.run && (command.batch || command.files.size() != 1 || options.object || options.streaming)) {
+      diagnostics << "--run takes a single file and no -c or --stream" << std::endl;
+      return false;
+    }
+
+    // An object file is laid out only once every function is compiled
+    if(options.object && options.streaming) {
+      diagnostics << "--stream can't be used with -c" << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  int execute(const Command &command, ThreadPool &pool, int out, std::ostream &diagnostics) {
+    const Options &options = command.options;
+    Cache::Cache *cache = options.cache;
+    size_t hits = cache ? cache->hits.load() : 0;
+    size_t misses = cache ? cache->misses.load() : 0;
+    int status;
+
+    if(options.printStats || options.timeReport)
+      Allocations::enable();
+
+    // A single file is compiled to out, several each to its own .asm.
+    // Object files are never written to out.
+    if(command.run)
+      status = run(command.files[0], pool, options, diagnostics);
+    else if(command.files.size() == 1 && !command.batch && !options.object)
+      status = compile(command.files[0], pool, options, out, diagnostics) ? 0 : 1;
+    else
+      status = compileBatch(command.files, pool, options, diagnostics) ? 0 : 1;
+
+    // Peak RSS is only known for the whole process, the server's when
+    // serving, so it is printed once rather than with every file
+    if(options.timeReport && !command.run)
+      TimeReport::printPeakRss(diagnostics, options.timeReportJson);
+
+    if(cache && options.printStats)
+      diagnostics << "Cache: " << cache->hits - hits << " hits, " << cache->misses - misses << " misses" << std::endl;
+
+    return status;
+  }
+}
@@ -0,0 +1,205 @@
+#include "elf.hpp"
+#include <cstring>
+#include <elf.h>
+
+namespace ELF {
+  // The order of the sections in the file
+  enum SectionIndex : uint16_t {
+    NullSection,
+    TextSection,
+    DataSection,
+    BssSection,
+    SymtabSection,
+    StrtabSection,
+    ShstrtabSection,
+    RelaTextSection,
+    RelaDataSection,
+    SectionCount
+  };
+
+  static const char *SECTION_NAMES[SectionCount] = {
+    "", ".text", ".data", ".bss", ".symtab", ".strtab", ".shstrtab", ".rela.text", ".rela.data"
+  };
+
+  static uint16_t sectionIndex(Section section) {
+    switch(section) {
+    case Section::Text: return TextSection;
+    case Section::Data: return DataSection;
+    case Section::Bss: return BssSection;
+    default: return SHN_UNDEF;
+    }
+  }
+
+  static uint32_t relocationType(MIR::RelocationType type) {
+    switch(type) {
+    case MIR::RelocationType::Abs64: return R_X86_64_64;
+    case MIR::RelocationType::Abs32: return R_X86_64_32;
+    case MIR::RelocationType::Abs32S: return R_X86_64_32S;
+    default: return R_X86_64_PC32;
+    }
+  }
+
+  template<typename T>
+  static void writeRaw(OutputBuffer &out, const T &value) {
+    out << std::string_view(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static void pad(OutputBuffer &out, uint64_t &offset, uint64_t alignment) {
+    while(offset % alignment != 0) {
+      out << '\0';
+      ++offset;
+    }
+  }
+
+  size_t ObjectFile::addSymbol(std::string name, Section section, uint64_t value, bool global) {
+    symbols.push_back({ std::move(name), section, value, global });
+    return symbols.size() - 1;
+  }
+
+  void ObjectFile::addRelocation(Section section, uint64_t offset, MIR::RelocationType type, size_t symbol, int64_t addend) {
+    relocations.push_back({ section, offset, type, symbol, addend });
+  }
+
+  void ObjectFile::write(OutputBuffer &out) const {
+    // The null symbol, then one for each section that has contents, in
+    // the order of the sections, so their index is that of the section
+    std::vector<Elf64_Sym> symtab(1 + 3);
+    std::vector<size_t> symtabIndex(symbols.size());
+    std::string strtab(1, '\0');
+    std::string shstrtab;
+
+    for(uint16_t i = TextSection; i <= BssSection; ++i) {
+      symtab[i].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+      symtab[i].st_shndx = i;
+    }
+
+    // Local symbols come first
+    for(int global = 0; global < 2; ++global) {
+      for(size_t i = 0; i < symbols.size(); ++i) {
+        const Symbol &symbol = symbols[i];
+
+        if(symbol.global != (global != 0))
+          continue;
+
+        Elf64_Sym sym{};
+        sym.st_name = static_cast<uint32_t>(strtab.size());
+        sym.st_info = static_cast<unsigned char>(ELF64_ST_INFO(symbol.global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE));
+        sym.st_shndx = sectionIndex(symbol.section);
+        sym.st_value = symbol.value;
+
+        strtab += symbol.name;
+        strtab += '\0';
+        symtabIndex[i] = symtab.size();
+        symtab.push_back(sym);
+      }
+    }
+
+    size_t firstGlobal = symtab.size();
+
+    for(size_t i = 0; i < symbols.size(); ++i) {
+      if(symbols[i].global) {
+        firstGlobal = symtabIndex[i];
+        break;
+      }
+    }
+
+    std::vector<Elf64_Rela> relaText, relaData;
+
+    for(auto &relocation : relocations) {
+      const Symbol &symbol = symbols[relocation.symbol];
+      Elf64_Rela rela{};
+      int64_t addend = relocation.addend;
+      size_t index = symtabIndex[relocation.symbol];
+
+      if(!symbol.global && symbol.section != Section::Undefined) {
+        index = sectionIndex(symbol.section);
+        addend += static_cast<int64_t>(symbol.value);
+      }
+
+      rela.r_offset = relocation.offset;
+      rela.r_info = ELF64_R_INFO(index, relocationType(relocation.type));
+      rela.r_addend = addend;
+
+      (relocation.section == Section::Text ? relaText : relaData).push_back(rela);
+    }
+
+    Elf64_Shdr sections[SectionCount]{};
+    uint64_t offset = sizeof(Elf64_Ehdr);
+
+    for(uint16_t i = 0; i < SectionCount; ++i) {
+      sections[i].sh_name = static_cast<uint32_t>(shstrtab.size());
+      shstrtab += SECTION_NAMES[i];
+      shstrtab += '\0';
+    }
+
+    auto place = [&](SectionIndex index, uint32_t type, uint64_t flags, uint64_t size, uint64_t alignment) {
+      offset = (offset + alignment - 1) / alignment * alignment;
+      sections[index].sh_type = type;
+      sections[index].sh_flags = flags;
+      sections[index].sh_offset = offset;
+      sections[index].sh_size = size;
+      sections[index].sh_addralign = alignment;
+
+      if(type != SHT_NOBITS)
+        offset += size;
+    };
+
+    place(TextSection, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, text.size(), 16);
+    place(DataSection, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, data.size(), 4);
+    place(BssSection, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, bssSize, 4);
+    place(SymtabSection, SHT_SYMTAB, 0, symtab.size() * sizeof(Elf64_Sym), 8);
+    place(StrtabSection, SHT_STRTAB, 0, strtab.size(), 1);
+    place(ShstrtabSection, SHT_STRTAB, 0, shstrtab.size(), 1);
+    place(RelaTextSection, SHT_RELA, SHF_INFO_LINK, relaText.size() * sizeof(Elf64_Rela), 8);
+    place(RelaDataSection, SHT_RELA, SHF_INFO_LINK, relaData.size() * sizeof(Elf64_Rela), 8);
+
+    sections[SymtabSection].sh_link = StrtabSection;
+    sections[SymtabSection].sh_info = static_cast<uint32_t>(firstGlobal);
+    sections[SymtabSection].sh_entsize = sizeof(Elf64_Sym);
+    sections[RelaTextSection].sh_link = SymtabSection;
+    sections[RelaTextSection].sh_info = TextSection;
+    sections[RelaTextSection].sh_entsize = sizeof(Elf64_Rela);
+    sections[RelaDataSection].sh_link = SymtabSection;
+    sections[RelaDataSection].sh_info = DataSection;
+    sections[RelaDataSection].sh_entsize = sizeof(Elf64_Rela);
+
+    uint64_t sectionHeaders = (offset + 7) / 8 * 8;
+
+    Elf64_Ehdr header{};
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = sectionHeaders;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = SectionCount;
+    header.e_shstrndx = ShstrtabSection;
+
+    uint64_t written = sizeof(Elf64_Ehdr);
+    writeRaw(out, header);
+
+    auto contents = [&](SectionIndex index, std::string_view bytes) {
+      pad(out, written, sections[index].sh_addralign);
+      out << bytes;
+      written += bytes.size();
+    };
+
+    contents(TextSection, std::string_view(reinterpret_cast<const char*>(text.data()), text.size()));
+    contents(DataSection, std::string_view(reinterpret_cast<const char*>(data.data()), data.size()));
+    contents(SymtabSection, std::string_view(reinterpret_cast<const char*>(symtab.data()), symtab.size() * sizeof(Elf64_Sym)));
+    contents(StrtabSection, strtab);
+    contents(ShstrtabSection, shstrtab);
+    contents(RelaTextSection, std::string_view(reinterpret_cast<const char*>(relaText.data()), relaText.size() * sizeof(Elf64_Rela)));
+    contents(RelaDataSection, std::string_view(reinterpret_cast<const char*>(relaData.data()), relaData.size() * sizeof(Elf64_Rela)));
+
+    pad(out, written, 8);
+
+    for(auto &section : sections)
+      writeRaw(out, section);
+  }
+}
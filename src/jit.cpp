@@ -0,0 +1,176 @@
+#include "jit.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace JIT {
+  // Host functions are too far from the code for a 32-bit call, so calls
+  // to them go through a stub: jmp [rip], then the address
+  static const uint8_t STUB[] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+  static constexpr size_t STUB_SIZE = 16;
+  // push rbx; call rdi; pop rbx; ret
+  static const uint8_t ENTRY[] = { 0x53, 0xFF, 0xD7, 0x5B, 0xC3 };
+  static constexpr size_t NO_STUB = std::numeric_limits<size_t>::max();
+
+  Error::Error(std::string err) : error(std::move(err)) {}
+
+  static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  template<typename T>
+  static void put(uint8_t *place, T value) {
+    std::memcpy(place, &value, sizeof(value));
+  }
+
+  static void put32(uint8_t *place, uint64_t value, bool isSigned, const std::string &name) {
+    auto fits = isSigned
+      ? static_cast<int64_t>(value) >= std::numeric_limits<int32_t>::min() &&
+        static_cast<int64_t>(value) <= std::numeric_limits<int32_t>::max()
+      : value <= std::numeric_limits<uint32_t>::max();
+
+    if(!fits)
+      throw Error("'" + name + "' is out of reach of a 32-bit address");
+
+    put(place, static_cast<uint32_t>(value));
+  }
+
+  Image::Image(const ELF::ObjectFile &object) : memory(nullptr), mappingSize(0), entry(nullptr) {
+    auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<size_t> stubs(object.symbols.size(), NO_STUB);
+    size_t stubCount = 0;
+
+    for(auto &relocation : object.relocations)
+      if(relocation.type == MIR::RelocationType::Pc32 &&
+         object.symbols[relocation.symbol].section == ELF::Section::Undefined &&
+         stubs[relocation.symbol] == NO_STUB)
+        stubs[relocation.symbol] = stubCount++;
+
+    // The code, the stubs and the entry, then the data and the bss on
+    // pages of their own, which stay writable
+    size_t stubsOffset = alignUp(object.text.size(), 16);
+    size_t entryOffset = stubsOffset + stubCount * STUB_SIZE;
+    size_t codeSize = alignUp(entryOffset + sizeof(ENTRY), pageSize);
+    size_t dataOffset = codeSize;
+    size_t bssOffset = alignUp(dataOffset + object.data.size(), 16);
+
+    mappingSize = alignUp(bssOffset + object.bssSize, pageSize);
+    void *mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+    if(mapping == MAP_FAILED)
+      throw Error("Can't map memory for the code");
+
+    memory = static_cast<uint8_t*>(mapping);
+    entry = memory + entryOffset;
+
+    try {
+      std::copy(object.text.begin(), object.text.end(), memory);
+      std::copy(object.data.begin(), object.data.end(), memory + dataOffset);
+      std::copy(std::begin(ENTRY), std::end(ENTRY), entry);
+
+      // Host symbols are looked up only once referenced, as a linker would
+      std::vector<uint64_t> addresses(object.symbols.size());
+
+      auto address = [&](size_t index) {
+        const ELF::Symbol &symbol = object.symbols[index];
+
+        if(addresses[index] != 0)
+          return addresses[index];
+
+        switch(symbol.section) {
+        case ELF::Section::Text: addresses[index] = reinterpret_cast<uint64_t>(memory + symbol.value); break;
+        case ELF::Section::Data: addresses[index] = reinterpret_cast<uint64_t>(memory + dataOffset + symbol.value); break;
+        case ELF::Section::Bss: addresses[index] = reinterpret_cast<uint64_t>(memory + bssOffset + symbol.value); break;
+        case ELF::Section::Undefined:
+          addresses[index] = reinterpret_cast<uint64_t>(dlsym(RTLD_DEFAULT, symbol.name.c_str()));
+
+          if(addresses[index] == 0)
+            throw Error("Undefined symbol '" + symbol.name + "'");
+        }
+
+        return addresses[index];
+      };
+
+      for(size_t i = 0; i < object.symbols.size(); ++i) {
+        if(stubs[i] == NO_STUB)
+          continue;
+
+        uint8_t *stub = memory + stubsOffset + stubs[i] * STUB_SIZE;
+
+        std::fill(stub, stub + STUB_SIZE, 0xCC);
+        std::copy(std::begin(STUB), std::end(STUB), stub);
+        put(stub + sizeof(STUB), address(i));
+      }
+
+      for(auto &relocation : object.relocations) {
+        uint8_t *place = memory + (relocation.section == ELF::Section::Text ? 0 : dataOffset) + relocation.offset;
+        const std::string &name = object.symbols[relocation.symbol].name;
+        uint64_t target = stubs[relocation.symbol] != NO_STUB
+          ? reinterpret_cast<uint64_t>(memory + stubsOffset + stubs[relocation.symbol] * STUB_SIZE)
+          : address(relocation.symbol);
+        uint64_t value = target + static_cast<uint64_t>(relocation.addend);
+
+        switch(relocation.type) {
+        case MIR::RelocationType::Abs64: put(place, value); break;
+        case MIR::RelocationType::Abs32: put32(place, value, false, name); break;
+        case MIR::RelocationType::Abs32S: put32(place, value, true, name); break;
+        case MIR::RelocationType::Pc32: put32(place, value - reinterpret_cast<uint64_t>(place), true, name); break;
+        }
+      }
+
+      if(mprotect(memory, codeSize, PROT_READ | PROT_EXEC) != 0)
+        throw Error("Can't make the code executable");
+    } catch(...) {
+      munmap(memory, mappingSize);
+      throw;
+    }
+
+    for(auto &symbol : object.symbols)
+      if(symbol.section == ELF::Section::Text)
+        functions.push_back({ symbol.name, memory + symbol.value, 0 });
+
+    std::sort(functions.begin(), functions.end(),
+              [](const Function &a, const Function &b) { return a.address < b.address; });
+
+    for(size_t i = 0; i < functions.size(); ++i) {
+      uint8_t *end = i + 1 < functions.size() ? functions[i + 1].address : memory + object.text.size();
+      functions[i].size = static_cast<size_t>(end - functions[i].address);
+    }
+  }
+
+  Image::~Image() {
+    munmap(memory, mappingSize);
+  }
+
+  bool Image::has(std::string_view name) const {
+    return std::any_of(functions.begin(), functions.end(),
+                       [name](const Function &function) { return function.name == name; });
+  }
+
+  int64_t Image::call(std::string_view name) const {
+    auto function = std::find_if(functions.begin(), functions.end(),
+                                 [name](const Function &f) { return f.name == name; });
+
+    if(function == functions.end())
+      throw Error("There's no function '" + std::string(name) + "'");
+
+    auto run = reinterpret_cast<int64_t (*)(uint8_t*)>(entry);
+    return run(function->address);
+  }
+
+  bool Image::writePerfMap() const {
+    std::ofstream map("/tmp/perf-" + std::to_string(getpid()) + ".map");
+
+    map << std::hex;
+
+    for(auto &function : functions)
+      map << reinterpret_cast<uint64_t>(function.address) << ' ' << function.size << ' ' << function.name << '\n';
+
+    return static_cast<bool>(map.flush());
+  }
+}
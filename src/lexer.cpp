@@ -1,14 +1,23 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
 #include <iostream>
 #include <sstream>
-#include <unordered_map>
 #include <stdexcept>
 #include "codefile.hpp"
 #include "lexer.hpp"
+#include "lexer_scan.hpp"
 #include "lexer_token.hpp"
+#include "thread_pool.hpp"
 
 #define ERROR_C(e) "\033[1;31m" e "\033[m"
 #define CUR_MOVE_RIGHT(x) "\033[" x "C"
 
+// Smaller files lex faster than the threads can be woken up
+static constexpr size_t PARALLEL_THRESHOLD = 4 << 20;
+static constexpr size_t PARALLEL_CHUNK = 1 << 20;
+
 inline bool isLetter(char ch) {
   return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
 }
@@ -24,246 +33,481 @@ inline std::string getUnderlineStr(const size_t len, const char ch = '^') {
   return underline;
 }
 
+inline char replaceEscapedChar(char ch) {
+  switch (ch) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'e':
+    return '\033';
+  case 'b':
+    return '\b';
+  case 'r':
+    return '\r';
+  default:
+    return ch;
+  }
+}
+
 namespace Lexer {
-  static std::unordered_map<std::string, OperatorType> OPERATORS = {
-    { "+", OperatorType::Plus },
-    { "-", OperatorType::Minus },
-    { "*", OperatorType::Multiply },
-    { "/", OperatorType::Divide },
-    { "=", OperatorType::Assign },
-    { "|", OperatorType::BinOr },
-    { "&", OperatorType::BinAnd },
-    { "^", OperatorType::Pow },
-    { "!", OperatorType::Not },
-    { "(", OperatorType::LeftParen },
-    { ")", OperatorType::RightParen },
-    { "[", OperatorType::LeftSquareParen },
-    { "]", OperatorType::RightSquareParen },
-    { "{", OperatorType::LeftFigureParen },
-    { "}", OperatorType::RightFigureParen },
-    { ">", OperatorType::More },
-    { "<", OperatorType::Less },
-    { ":", OperatorType::Colon },
-    { ";", OperatorType::Semicolon },
-    { ",", OperatorType::Comma },
-    { "==", OperatorType::Equals },
-    { "!=", OperatorType::NotEquals },
-    { ">=", OperatorType::MoreOrEquals },
-    { "<=", OperatorType::LessOrEquals },
-    { "||", OperatorType::Or },
-    { "&&", OperatorType::And },
-    { "@", OperatorType::At },
-    { "=>", OperatorType::HardArrowRight },
-    { "->", OperatorType::ArrowRight },
-    { "++", OperatorType::Increment },
-    { "--", OperatorType::Decrement },
-    { "%", OperatorType::Percent },
+  struct KeywordEntry {
+    std::string_view name;
+    Keyword keyword;
   };
 
-  Lexer::Lexer(const CodeFile::CodeFile &cfile)
-    : position(Position(0, 0)), currentChar(cfile.fileData[0]), codeFile(cfile) {
-    position.lineEnd = findLineEnd();
+  static constexpr KeywordEntry KEYWORDS[] = {
+    { "var",    Keyword::Var },
+    { "fn",     Keyword::Fn },
+    { "if",     Keyword::If },
+    { "while",  Keyword::While },
+    { "for",    Keyword::For },
+    { "def",    Keyword::Def },
+    { "extern", Keyword::Extern },
+    { "static", Keyword::Static },
+    { "as",     Keyword::As },
+    { "else",   Keyword::Else },
+  };
+
+  // Perfect hash for KEYWORDS: the first two characters and the length
+  // already put every keyword into its own slot
+  constexpr size_t keywordHash(std::string_view str) {
+    return (static_cast<unsigned char>(str[0]) +
+            static_cast<unsigned char>(str[1]) * 13u + str.size()) & 15u;
   }
 
-  size_t Lexer::findLineEnd() {
-    size_t i = position.lineBegin;
+  constexpr std::array<KeywordEntry, 16> makeKeywordTable() {
+    std::array<KeywordEntry, 16> table{};
+
+    for(auto &kw : KEYWORDS) {
+      if(table[keywordHash(kw.name)].keyword != Keyword::None)
+        return {};
 
-    while(codeFile.fileData[i] != 0 && codeFile.fileData[i++] != '\n');
+      table[keywordHash(kw.name)] = kw;
+    }
 
-    return codeFile.fileData[i] ? i - 1 : i;
+    return table;
   }
-  
+
+  static constexpr std::array<KeywordEntry, 16> KEYWORD_TABLE = makeKeywordTable();
+
+  static_assert(KEYWORD_TABLE[keywordHash("var")].keyword == Keyword::Var,
+                "keywordHash has collisions, pick other multipliers");
+
+  inline Keyword findKeyword(std::string_view str) {
+    if(str.size() < 2)
+      return Keyword::None;
+
+    const KeywordEntry &entry = KEYWORD_TABLE[keywordHash(str)];
+
+    return entry.name == str ? entry.keyword : Keyword::None;
+  }
+
+  constexpr std::array<OperatorType, 256> makeOperatorTable() {
+    std::array<OperatorType, 256> table{};
+
+    table['+'] = OperatorType::Plus;
+    table['-'] = OperatorType::Minus;
+    table['*'] = OperatorType::Multiply;
+    table['/'] = OperatorType::Divide;
+    table['='] = OperatorType::Assign;
+    table['|'] = OperatorType::BinOr;
+    table['&'] = OperatorType::BinAnd;
+    table['^'] = OperatorType::Pow;
+    table['!'] = OperatorType::Not;
+    table['('] = OperatorType::LeftParen;
+    table[')'] = OperatorType::RightParen;
+    table['['] = OperatorType::LeftSquareParen;
+    table[']'] = OperatorType::RightSquareParen;
+    table['{'] = OperatorType::LeftFigureParen;
+    table['}'] = OperatorType::RightFigureParen;
+    table['>'] = OperatorType::More;
+    table['<'] = OperatorType::Less;
+    table[':'] = OperatorType::Colon;
+    table[';'] = OperatorType::Semicolon;
+    table[','] = OperatorType::Comma;
+    table['@'] = OperatorType::At;
+    table['%'] = OperatorType::Percent;
+
+    return table;
+  }
+
+  static constexpr std::array<OperatorType, 256> OPERATORS = makeOperatorTable();
+
+  // Maximal munch: every two-character operator starts with a one-character
+  // one, so the first character selects the state and the second one decides
+  // whether the longer operator matches
+  constexpr OperatorType matchOperator(char first, char second, size_t &length) {
+    length = 2;
+
+    switch(first) {
+    case '=':
+      if(second == '=') return OperatorType::Equals;
+      if(second == '>') return OperatorType::HardArrowRight;
+      break;
+    case '!':
+      if(second == '=') return OperatorType::NotEquals;
+      break;
+    case '>':
+      if(second == '=') return OperatorType::MoreOrEquals;
+      break;
+    case '<':
+      if(second == '=') return OperatorType::LessOrEquals;
+      break;
+    case '|':
+      if(second == '|') return OperatorType::Or;
+      break;
+    case '&':
+      if(second == '&') return OperatorType::And;
+      break;
+    case '-':
+      if(second == '>') return OperatorType::ArrowRight;
+      if(second == '-') return OperatorType::Decrement;
+      break;
+    case '+':
+      if(second == '+') return OperatorType::Increment;
+      break;
+    default:
+      break;
+    }
+
+    length = 1;
+
+    return OPERATORS[static_cast<unsigned char>(first)];
+  }
+
+  Error::Error(size_t off, std::string err) : offset(off), error(err) {}
+
+  Lexer::Lexer(const CodeFile::CodeFile &cfile, ThreadPool *pool_)
+    : Lexer(cfile, 0, cfile.fileData.size()) {
+    if(pool_ && pool_->size() > 1 && data.size() >= PARALLEL_THRESHOLD) {
+      pool = pool_;
+      scheduled = 0;
+
+      for(size_t i = 0; i < pool->size() * 2; ++i)
+        scheduleChunk();
+    }
+  }
+
+  // Lexes the [begin, end) slice of the file. Offsets stay relative to the
+  // whole file, so tokens of different slices can be concatenated as is.
+  Lexer::Lexer(const CodeFile::CodeFile &cfile, const size_t begin, const size_t end)
+    : offset(begin), codeFile(cfile), data(cfile.fileData.substr(0, end)),
+      pool(nullptr), scheduled(end) {
+    currentChar = charAt(begin);
+  }
+
+  Lexer::~Lexer() {}
+
+  // The mapped buffer isn't NUL-terminated, so reads past the end yield 0
+  char Lexer::charAt(size_t i) const {
+    return i < data.size() ? data[i] : 0;
+  }
+
   char Lexer::nextChar() {
     if(currentChar == 0)
       return 0;
 
-    currentChar = codeFile.fileData[++position.charNumber];
-
-    if(currentChar == '\n') {
-      ++position.lineNumber;
-      position.lineBegin = position.charNumber + 1;
-      position.lineEnd = findLineEnd();
-    }
+    currentChar = charAt(++offset);
 
     return currentChar;
   }
+
+  void Lexer::seek(size_t off) {
+    offset = off;
+    currentChar = charAt(offset);
+  }
   
+  void Lexer::finishToken(Token &token) {
+    size_t length = offset - token.offset;
+
+    if(length < Token::LONG_LENGTH) {
+      token.length = static_cast<uint16_t>(length);
+      return;
+    }
+
+    // Only the literals that have no value to carry can be long
+    if(token.type != Type::String && token.type != Type::Identifier) {
+      offset = token.offset;
+
+      throw std::string("Token is too long");
+    }
+
+    token.length = Token::LONG_LENGTH;
+    token.integer = static_cast<int64_t>(length);
+  }
+
   Token Lexer::getNumberToken() {
-    Token token = Token(Type::Integer, "", position);
+    Token token = Token(Type::Integer, offset);
 
-    do {
-      if(currentChar == '.') {
-        if(token.type == Type::Float)
-          throw std::string("Unexpected second entry of char '.'");
-        else
-          token.type = Type::Float;
-      }
-      
-      token.value.push_back(currentChar);
-    } while(isDigit(nextChar()) || currentChar == '.');
+    seek(scanDigits(data, offset));
+
+    while(currentChar == '.') {
+      if(token.type == Type::Float)
+        throw std::string("Unexpected second entry of char '.'");
+
+      token.type = Type::Float;
+      seek(scanDigits(data, offset + 1));
+    }
 
-    if(token.value[token.value.length() - 1] == '.')
+    if(charAt(offset - 1) == '.')
       throw std::string("Unfinished float number entry");
     else if(isLetter(currentChar))
       throw std::string("Unexpected letter after number entry");
-    
-    return token;
-  }
 
+    finishToken(token);
 
-  char Lexer::replaceEscapedChar(char ch) {
-    switch (ch) {
-    case 'n':
-      return '\n';
-    case 't':
-      return '\t';
-    case 'e':
-      return '\033';
-    case 'b':
-      return '\b';
-    case 'r':
-      return '\r';
-    default:
-      return ch;
+    const char *begin = data.data() + token.offset;
+    std::from_chars_result res;
+
+    if(token.type == Type::Float)
+      res = std::from_chars(begin, begin + token.length, token.real);
+    else
+      res = std::from_chars(begin, begin + token.length, token.integer);
+
+    if(res.ec != std::errc()) {
+      offset = token.offset;
+
+      throw std::string("Numeric constant is too large");
     }
+
+    return token;
   }
-  
-  Token Lexer::getStringToken() {
-    Token token = Token(Type::String, "", position);
-    char prevChar = currentChar;
-    bool escaped = false;
 
-    while(nextChar() != '"' || prevChar == '\\') {
-      if(currentChar == 0 || currentChar == '\n') {
-        position = token.position;
-        
-        throw std::string("Missing terminating '\"' character");
-      }
+  std::string decodeString(std::string_view literal) {
+    std::string str;
+    char prevChar = '"';
+    bool escaped = false;
 
+    for(char ch : literal.substr(1, literal.size() - 2)) {
       if(prevChar == '\\' && !escaped) {
         escaped = true;
-        token.value.push_back(replaceEscapedChar(currentChar));
-      } else if(currentChar != '\\') {
+        str.push_back(replaceEscapedChar(ch));
+      } else if(ch != '\\') {
         escaped = false;
-        token.value.push_back(currentChar);
+        str.push_back(ch);
       } else {
         escaped = false;
       }
 
-      prevChar = currentChar;
+      prevChar = ch;
     }
 
-    token.value.insert(0, "\"");
-    token.value.push_back('\"');
+    return str;
+  }
+  
+  Token Lexer::getStringToken() {
+    Token token = Token(Type::String, offset);
+
+    do {
+      seek(scanStringBody(data, offset + 1));
+
+      if(currentChar == 0 || currentChar == '\n') {
+        offset = token.offset;
+
+        throw std::string("Missing terminating '\"' character");
+      }
+    } while(charAt(offset - 1) == '\\');
 
     nextChar();
-    
+    finishToken(token);
+
     return token;
   };
-  
+
   Token Lexer::getCharToken() {
-    Token token = Token(Type::Char, "", position);
+    Token token = Token(Type::Char, offset);
     char prevChar = currentChar;
+    size_t charsCount = 0;
+
+    token.integer = '\'';
 
     while(nextChar() != '\'') {
       if(currentChar == 0 || currentChar == '\n') {
-        position = token.position;
+        offset = token.offset;
         
         throw std::string("Missing terminating ''' character");
       }
       
-      if((prevChar != '\\' && token.value.length() == 1) ||
-         (token.value.length() > 2)) {
-        position = token.position;
+      if((prevChar != '\\' && charsCount == 1) || charsCount > 2) {
+        offset = token.offset;
 
         throw std::string("Multi-character constant");
       }
 
-      if(prevChar == '\\')
-        token.value.push_back(replaceEscapedChar(currentChar));
-      else if(currentChar != '\\')
-        token.value.push_back(currentChar);
+      if(prevChar == '\\' || currentChar != '\\') {
+        if(charsCount++ == 0)
+          token.integer = prevChar == '\\' ? replaceEscapedChar(currentChar) : currentChar;
+      }
       
       prevChar = currentChar;
     }
 
-    token.value.insert(0, "'");
-    token.value.push_back('\'');
-
     nextChar();
+    finishToken(token);
 
     return token;
   };
 
   Token Lexer::getIdentifierToken() {
-    Token token = Token(Type::Identifier, "", position);
+    Token token = Token(Type::Identifier, offset);
 
-    do {
-      token.value.push_back(currentChar);
-    } while(isDigit(nextChar()) || isLetter(currentChar) || currentChar == '_');
+    seek(scanIdentifier(data, offset + 1));
+    finishToken(token);
+
+    if(token.length != Token::LONG_LENGTH)
+      token.integer = static_cast<int64_t>(findKeyword(token.value(data)));
 
     return token;
   }
 
   Token Lexer::getOperatorToken() {
-    Token token = Token(Type::Operator, "", position);
+    Token token = Token(Type::Operator, offset);
+    size_t length = 0;
 
-    do {
-      token.value.push_back(currentChar);
-      
-      if(!OPERATORS.count(token.value)) {
-        token.value.pop_back();
+    token.operatorType = matchOperator(currentChar, charAt(offset + 1), length);
 
-        if(OPERATORS.count(token.value))
-          token.operatorType = OPERATORS[token.value];
-        else {
-          token.value.push_back(currentChar);
-          
-          throw std::string("Unexpected token '" + token.value + "'");
-        }
+    if(token.operatorType == OperatorType::None)
+      throw std::string("Unexpected token '" + std::string(1, currentChar) + "'");
+
+    while(length-- != 0)
+      nextChar();
+
+    finishToken(token);
 
-        break;
-      }
-    } while(nextChar() != 0);
-    
     return token;
   }
 
-  void Lexer::printError(const Position pos, const std::string &errMsg, const size_t underlineLen) {
+  // Line and column are only needed for diagnostics, so they are recovered
+  // from the byte offset on demand
+  Position Lexer::getPosition(const size_t off) {
+    size_t line = codeFile.getLineNumber(off);
+    Position pos(line, off);
+
+    pos.lineBegin = codeFile.lineBegins[line];
+    pos.lineEnd = line + 1 < codeFile.lineBegins.size()
+      ? codeFile.lineBegins[line + 1] - 1
+      : codeFile.fileData.size();
+
+    return pos;
+  }
+
+  void Lexer::printError(const size_t off, const std::string &errMsg, const size_t underlineLen) {
+    printError(std::cerr, off, errMsg, underlineLen);
+  }
+
+  void Lexer::printError(std::ostream &out, const size_t off, const std::string &errMsg, const size_t underlineLen) {
+    Position pos = getPosition(off);
     size_t errorCharNumInString = pos.charNumber - pos.lineBegin;
     size_t errorPtrPosition     = errorCharNumInString + std::to_string(pos.lineNumber+1).length() + 4;
-    std::string errorCodeString = codeFile.fileData.substr(pos.lineBegin, pos.lineEnd - pos.lineBegin);
+    std::string_view errorCodeString = codeFile.fileData.substr(pos.lineBegin, pos.lineEnd - pos.lineBegin);
     
-    std::cerr << std::endl
-              << codeFile.fileName << ':' << pos.lineNumber + 1 << ':' << errorCharNumInString + 1 << ": " << ERROR_C("Error") ": " << errMsg << std::endl
-              << ' ' << pos.lineNumber + 1 << " | " << errorCodeString << std::endl
-              << CUR_MOVE_RIGHT(<< errorPtrPosition <<) ERROR_C(<< getUnderlineStr(underlineLen) <<) << std::endl;
+    out << std::endl
+        << codeFile.fileName << ':' << pos.lineNumber + 1 << ':' << errorCharNumInString + 1 << ": " << ERROR_C("Error") ": " << errMsg << std::endl
+        << ' ' << pos.lineNumber + 1 << " | " << errorCodeString << std::endl
+        << CUR_MOVE_RIGHT(<< errorPtrPosition <<) ERROR_C(<< getUnderlineStr(underlineLen) <<) << std::endl;
   }
 
-  TokenList Lexer::tokenize() {
-    do {
+  Token Lexer::lexToken() {
+    if(currentChar == ' ' || currentChar == '\n')
+      seek(skipWhitespace(data, offset));
+
+    if(currentChar == 0)
+      return Token(Type::EndOfFile, offset);
+    else if(isDigit(currentChar))
+      return getNumberToken();
+    else if(isLetter(currentChar) || currentChar == '_')
+      return getIdentifierToken();
+    else if(currentChar == '"')
+      return getStringToken();
+    else if(currentChar == '\'')
+      return getCharToken();
+    else
+      return getOperatorToken();
+  }
+
+  // No token spans a line break, so slices cut right after a '\n' lex
+  // independently. They are consumed in order, hence the first error seen
+  // is the first error of the file, just like with the serial path.
+  void Lexer::scheduleChunk() {
+    const size_t size = codeFile.fileData.size();
+
+    if(scheduled >= size)
+      return;
+
+    size_t end = std::min(size, scheduled + PARALLEL_CHUNK);
+    const void *newline = memchr(codeFile.fileData.data() + end, '\n', size - end);
+
+    end = newline
+      ? static_cast<size_t>(static_cast<const char *>(newline) - codeFile.fileData.data()) + 1
+      : size;
+
+    chunks.emplace_back();
+
+    Chunk &chunk = chunks.back();
+
+    chunk.begin = scheduled;
+    chunk.end = end;
+    chunk.task = std::make_unique<TaskGroup>(*pool);
+    scheduled = end;
+
+    chunk.task->run([this, &chunk]() {
+      Lexer lexer(codeFile, chunk.begin, chunk.end);
+
+      chunk.tokens.reserve((chunk.end - chunk.begin) / 4 + 1);
+
       try {
-      if(currentChar == ' ' || currentChar == '\n')
-        nextChar();
-      else if(isDigit(currentChar))
-        tokenList.push_back(getNumberToken());
-      else if(isLetter(currentChar) || currentChar == '_')
-        tokenList.push_back(getIdentifierToken());
-      else if(currentChar == '"')
-        tokenList.push_back(getStringToken());
-      else if(currentChar == '\'')
-        tokenList.push_back(getCharToken());
-      else
-        tokenList.push_back(getOperatorToken());
-      } catch(std::string e) {
-        printError(position, e);
-        
-        tokenList.clear();
+        for(Token tok = lexer.nextToken(); tok.type != Type::EndOfFile; tok = lexer.nextToken())
+          chunk.tokens.push_back(tok);
+
+        chunk.stop = lexer.offset;
+      } catch(Error &e) {
+        chunk.failed = true;
+        chunk.errorOffset = e.offset;
+        chunk.error = std::move(e.error);
+      }
+    });
+  }
+
+  Token Lexer::nextChunkToken() {
+    while(!chunks.empty()) {
+      Chunk &chunk = chunks.front();
 
-        return tokenList;
+      if(chunk.task) {
+        chunk.task->wait();
+        chunk.task.reset();
       }
-    } while(currentChar != 0);
-    
-    return tokenList;
+
+      if(chunk.next < chunk.tokens.size())
+        return chunk.tokens[chunk.next++];
+
+      if(chunk.failed)
+        throw Error(chunk.errorOffset, chunk.error);
+
+      // The serial lexer stops at a NUL byte, so must the chunked one
+      if(chunk.stop < chunk.end) {
+        offset = chunk.stop;
+        chunks.clear();
+
+        break;
+      }
+
+      offset = chunk.end;
+      chunks.pop_front();
+      scheduleChunk();
+    }
+
+    return Token(Type::EndOfFile, offset);
+  }
+
+  Token Lexer::nextToken() {
+    if(pool)
+      return nextChunkToken();
+
+    try {
+      return lexToken();
+    } catch(std::string e) {
+      throw Error(offset, e);
+    }
   }
 }
@@ -0,0 +1,188 @@
+#include "lexer_scan.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LEXER_SCAN_X86
+#endif
+
+namespace Lexer {
+  typedef size_t (*Scanner)(const char *data, size_t size, size_t from);
+
+  struct Scanners {
+    Scanner whitespace;
+    Scanner identifier;
+    Scanner digits;
+    Scanner stringBody;
+  };
+
+  inline bool isWhitespaceChar(char ch) { return ch == ' ' || ch == '\n'; }
+
+  inline bool isIdentifierChar(char ch) {
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_';
+  }
+
+  inline bool isDigitChar(char ch) { return ch >= '0' && ch <= '9'; }
+
+  // A NUL ends the literal like the end of the input does
+  inline bool isStringBodyChar(char ch) { return ch != '"' && ch != '\n' && ch != '\0'; }
+
+  template<bool (*inRun)(char)>
+  static size_t scanScalar(const char *data, size_t size, size_t from) {
+    while(from < size && inRun(data[from]))
+      ++from;
+
+    return from;
+  }
+
+#ifdef LEXER_SCAN_X86
+  // Bit masks of the bytes that belong to each run. Signed compares
+  // are fine: bytes >= 0x80 are negative and fall outside every range.
+  struct Sse2 {
+    typedef __m128i Vector;
+    static constexpr size_t width = 16;
+
+    static Vector load(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static unsigned mask(Vector v) { return static_cast<unsigned>(_mm_movemask_epi8(v)); }
+
+    static Vector inRange(Vector v, char lo, char hi) {
+      return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                           _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1))));
+    }
+
+    static unsigned whitespace(Vector v) {
+      return mask(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    }
+
+    static unsigned identifier(Vector v) {
+      Vector letters = inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+
+      return mask(_mm_or_si128(_mm_or_si128(letters, inRange(v, '0', '9')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+    }
+
+    static unsigned digits(Vector v) { return mask(inRange(v, '0', '9')); }
+
+    static unsigned stringBody(Vector v) {
+      Vector ends = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+
+      return ~mask(_mm_or_si128(ends, _mm_cmpeq_epi8(v, _mm_setzero_si128()))) & 0xFFFFu;
+    }
+  };
+
+  struct Avx2 {
+    typedef __m256i Vector;
+    static constexpr size_t width = 32;
+
+    __attribute__((target("avx2")))
+    static Vector load(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+
+    __attribute__((target("avx2")))
+    static unsigned mask(Vector v) { return static_cast<unsigned>(_mm256_movemask_epi8(v)); }
+
+    __attribute__((target("avx2")))
+    static Vector inRange(Vector v, char lo, char hi) {
+      return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                              _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), v));
+    }
+
+    __attribute__((target("avx2")))
+    static unsigned whitespace(Vector v) {
+      return mask(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    }
+
+    __attribute__((target("avx2")))
+    static unsigned identifier(Vector v) {
+      Vector letters = inRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+
+      return mask(_mm256_or_si256(_mm256_or_si256(letters, inRange(v, '0', '9')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+    }
+
+    __attribute__((target("avx2")))
+    static unsigned digits(Vector v) { return mask(inRange(v, '0', '9')); }
+
+    __attribute__((target("avx2")))
+    static unsigned stringBody(Vector v) {
+      Vector ends = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+
+      return ~mask(_mm256_or_si256(ends, _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+    }
+  };
+
+  // Looks at a full vector at a time and stops at the first byte outside
+  // the run; the tail shorter than a vector is left to the scalar loop
+  template<unsigned (*classify)(Sse2::Vector), bool (*inRun)(char)>
+  static size_t scanSse2(const char *data, size_t size, size_t from) {
+    while(from + Sse2::width <= size) {
+      unsigned stop = ~classify(Sse2::load(data + from)) & 0xFFFFu;
+
+      if(stop != 0)
+        return from + static_cast<size_t>(__builtin_ctz(stop));
+
+      from += Sse2::width;
+    }
+
+    return scanScalar<inRun>(data, size, from);
+  }
+
+  // Same loop, compiled for AVX2 so the vector helpers are inlined
+  template<unsigned (*classify)(Avx2::Vector), bool (*inRun)(char)>
+  __attribute__((target("avx2")))
+  static size_t scanAvx2(const char *data, size_t size, size_t from) {
+    while(from + Avx2::width <= size) {
+      unsigned stop = ~classify(Avx2::load(data + from));
+
+      if(stop != 0)
+        return from + static_cast<size_t>(__builtin_ctz(stop));
+
+      from += Avx2::width;
+    }
+
+    return scanScalar<inRun>(data, size, from);
+  }
+#endif
+
+  static Scanners selectScanners() {
+#ifdef LEXER_SCAN_X86
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2"))
+      return Scanners {
+        scanAvx2<Avx2::whitespace, isWhitespaceChar>,
+        scanAvx2<Avx2::identifier, isIdentifierChar>,
+        scanAvx2<Avx2::digits, isDigitChar>,
+        scanAvx2<Avx2::stringBody, isStringBodyChar>,
+      };
+
+    return Scanners {
+      scanSse2<Sse2::whitespace, isWhitespaceChar>,
+      scanSse2<Sse2::identifier, isIdentifierChar>,
+      scanSse2<Sse2::digits, isDigitChar>,
+      scanSse2<Sse2::stringBody, isStringBodyChar>,
+    };
+#else
+    return Scanners {
+      scanScalar<isWhitespaceChar>,
+      scanScalar<isIdentifierChar>,
+      scanScalar<isDigitChar>,
+      scanScalar<isStringBodyChar>,
+    };
+#endif
+  }
+
+  static const Scanners SCANNERS = selectScanners();
+
+  size_t skipWhitespace(std::string_view data, size_t from) {
+    return SCANNERS.whitespace(data.data(), data.size(), from);
+  }
+
+  size_t scanIdentifier(std::string_view data, size_t from) {
+    return SCANNERS.identifier(data.data(), data.size(), from);
+  }
+
+  size_t scanDigits(std::string_view data, size_t from) {
+    return SCANNERS.digits(data.data(), data.size(), from);
+  }
+
+  size_t scanStringBody(std::string_view data, size_t from) {
+    return SCANNERS.stringBody(data.data(), data.size(), from);
+  }
+}
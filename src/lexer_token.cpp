@@ -12,7 +12,8 @@ static std::string DBG_TYPENAMES[] = {
   "String",
   "Identifier",
   "Char",
-  "Operator"
+  "Operator",
+  "EndOfFile"
 };
     
   static std::string DBG_LEXER_OPTYPENAMES[] = {
@@ -49,15 +50,23 @@ static std::string DBG_TYPENAMES[] = {
   };
   
 namespace Lexer {
-  Token::Token(const Type T, const std::string V, const Position pos)
-    : type(T), operatorType(OperatorType::None), value(V), position(pos) {}
+  Token::Token(const Type T, const size_t off)
+    : offset(static_cast<uint32_t>(off)), length(0), type(T), operatorType(OperatorType::None), integer(0) {}
 
-  void Token::printTokenJSON() {
+  std::string_view Token::value(std::string_view source) const {
+    return source.substr(offset, size());
+  }
+
+  Keyword Token::keyword() const {
+    return type == Type::Identifier && length != LONG_LENGTH ? static_cast<Keyword>(integer) : Keyword::None;
+  }
+
+  void Token::printTokenJSON(std::string_view source) {
     std::cout <<
       "{ "
       KEY("\"type\"") ": "  VALUE_STRING("\"" << DBG_TYPENAMES[static_cast<size_t>(type)] << "\"") ", "
       KEY("\"optype\"") ": "  VALUE_STRING("\"" << DBG_LEXER_OPTYPENAMES[static_cast<size_t>(operatorType)] << "\"") ", "
-      KEY("\"value\"") ": " VALUE_STRING("\"" << value << "\"") ", "
+      KEY("\"value\"") ": " VALUE_STRING("\"" << value(source) << "\"") ", "
       "}, \n";
   }
 }
@@ -1,27 +1,54 @@
-#include "codefile.hpp"
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "compiler.hpp"
+#include "driver.hpp"
+#include "server.hpp"
+#include "thread_pool.hpp"
+#include "cache.hpp"
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 
 int main(int argc, char **argv) {
-  (void) argc;
+  std::vector<std::string> args(argv, argv + argc);
+  auto connect = std::find(args.begin() + 1, args.end(), "--connect");
 
-  CodeFile::CodeFile file(argv[1]);
+  // Everything else is for the server to read
+  if(connect != args.end()) {
+    if(connect + 1 == args.end()) {
+      std::cerr << "--connect takes a socket" << std::endl;
+      return 1;
+    }
 
-  Lexer::Lexer lexer(file);
-  Lexer::TokenList tlist = lexer.tokenize();
+    std::string socketPath = *(connect + 1);
+    args.erase(connect, connect + 2);
+    return Server::request(socketPath, args);
+  }
 
-  try {
-    Parser::Parser prs(tlist);
+  Driver::Command command;
 
-    Compiler::NonsenseCompiler comp(prs.stmts);
-    
-    std::cout << comp.asmCode;
-  } catch(Parser::Error &e) {
-    lexer.printError(e.token.position, e.error);
+  if(!Driver::parseCommand(args, "", command, std::cerr))
     return 1;
+
+  size_t threads = command.threads != 0 ? command.threads : std::max(1u, std::thread::hardware_concurrency());
+  std::unique_ptr<Cache::Cache> cache;
+
+  if(!command.server.empty()) {
+    Cache::Cache serverCache(command.cacheDirectory, true);
+    // The thread that accepts connections doesn't take tasks, so the pool
+    // gets one more
+    ThreadPool pool(threads + 1);
+
+    return Server::serve(command.server, pool, serverCache);
   }
-  
-  return 0;
+
+  if(!command.cacheDirectory.empty()) {
+    cache = std::make_unique<Cache::Cache>(command.cacheDirectory);
+    command.options.cache = cache.get();
+  }
+
+  ThreadPool pool(threads);
+
+  return Driver::execute(command, pool, STDOUT_FILENO, std::cerr);
 }
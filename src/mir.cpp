@@ -0,0 +1,159 @@
+#include "mir.hpp"
+#include <array>
+
+namespace MIR {
+  // Most blocks are short; this saves regrowing them from one instruction
+  static constexpr size_t BLOCK_RESERVE = 16;
+
+  static const std::array<std::string_view, 18> REG_NAMES = {
+    "",
+    "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp", "r8", "r9", "r10",
+    "eax", "ebx", "ecx", "edx",
+    "al", "bl"
+  };
+
+  static const std::array<std::string_view, 5> SIZE_NAMES = {
+    "", "byte", "word", "dword", "qword"
+  };
+
+  Operand reg(Reg r) {
+    Operand op;
+    op.kind = Operand::Kind::Reg;
+    op.reg = r;
+    return op;
+  }
+
+  Operand imm(int64_t value) {
+    Operand op;
+    op.kind = Operand::Kind::Imm;
+    op.value = value;
+    return op;
+  }
+
+  Operand hex(int64_t value) {
+    Operand op = imm(value);
+    op.flags = 1;
+    return op;
+  }
+
+  Operand mem(Size size, Reg base, int64_t disp, Reg index, uint8_t scale) {
+    Operand op;
+    op.kind = Operand::Kind::Mem;
+    op.size = size;
+    op.reg = base;
+    op.index = index;
+    op.scale = scale;
+    op.value = disp;
+    return op;
+  }
+
+  Operand mem(Size size, const Lexer::Token &symbol) {
+    Operand op;
+    op.kind = Operand::Kind::Mem;
+    op.size = size;
+    op.length = static_cast<uint32_t>(symbol.size());
+    op.value = static_cast<int64_t>(symbol.offset);
+    return op;
+  }
+
+  Operand symbol(const Lexer::Token &name) {
+    Operand op;
+    op.kind = Operand::Kind::Symbol;
+    op.length = static_cast<uint32_t>(name.size());
+    op.value = static_cast<int64_t>(name.offset);
+    return op;
+  }
+
+  Operand text(const Lexer::Token &tok) {
+    Operand op = symbol(tok);
+    op.kind = Operand::Kind::Text;
+    return op;
+  }
+
+  Operand label(LabelKind kind, int64_t id) {
+    Operand op;
+    op.kind = Operand::Kind::Label;
+    op.flags = static_cast<uint8_t>(kind);
+    op.value = id;
+    return op;
+  }
+
+  Operand stringLiteral(size_t number) {
+    Operand op;
+    op.kind = Operand::Kind::StringLiteral;
+    op.value = static_cast<int64_t>(number);
+    return op;
+  }
+
+  std::string_view regName(Reg r) {
+    return REG_NAMES[static_cast<size_t>(r)];
+  }
+
+  std::string_view sizeName(Size size) {
+    return SIZE_NAMES[static_cast<size_t>(size)];
+  }
+
+  Code::Code() : blockEnded(true), pendingInstructions(0) {}
+
+  void Code::startBlock() {
+    blocks.emplace_back();
+    blocks.back().instructions.reserve(BLOCK_RESERVE);
+    blockEnded = false;
+  }
+
+  void Code::label(Operand name) {
+    if(!blocks.empty() && !blocks.back().instructions.empty())
+      blockEnded = true;
+
+    emit(Opcode::Label, name);
+  }
+
+  // Inline assembly may hold labels and jumps of its own, so it is kept in
+  // a block apart
+  void Code::raw(std::string text) {
+    if(!blocks.empty() && !blocks.back().instructions.empty())
+      blockEnded = true;
+
+    rawText.push_back(std::move(text));
+    emit(Opcode::Raw, imm(static_cast<int64_t>(rawText.size() - 1)));
+    blockEnded = true;
+  }
+
+  Instruction &Code::at(Position position) {
+    return blocks[position.block].instructions[position.index];
+  }
+
+  const std::vector<Block> &Code::getBlocks() const {
+    return blocks;
+  }
+
+  size_t Code::finishedBlocks() const {
+    return blockEnded ? blocks.size() : blocks.size() - 1;
+  }
+
+  size_t Code::pending() const {
+    return pendingInstructions;
+  }
+
+  void Code::release(size_t first, size_t last) {
+    for(size_t i = first; i < last; ++i)
+      std::vector<Instruction>().swap(blocks[i].instructions);
+
+    pendingInstructions = 0;
+  }
+
+  const std::string &Code::getRawText(size_t index) const {
+    return rawText[index];
+  }
+
+  bool Code::empty() const {
+    return blocks.empty();
+  }
+
+  void Code::clear() {
+    std::vector<Block>().swap(blocks);
+    std::vector<std::string>().swap(rawText);
+    blockEnded = true;
+    pendingInstructions = 0;
+  }
+}
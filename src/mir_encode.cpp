@@ -0,0 +1,514 @@
+#include "mir.hpp"
+#include <array>
+#include <charconv>
+#include <initializer_list>
+#include <unordered_map>
+
+namespace MIR {
+  // Register numbers as used in ModRM, SIB and REX, indexed by Reg
+  static const std::array<uint8_t, 18> REG_NUMBERS = {
+    0,
+    0, 3, 1, 2, 6, 7, 5, 4, 8, 9, 10,
+    0, 3, 1, 2,
+    0, 3
+  };
+
+  static const std::array<Size, 18> REG_SIZES = {
+    Size::None,
+    Size::Qword, Size::Qword, Size::Qword, Size::Qword, Size::Qword, Size::Qword,
+    Size::Qword, Size::Qword, Size::Qword, Size::Qword, Size::Qword,
+    Size::Dword, Size::Dword, Size::Dword, Size::Dword,
+    Size::Byte, Size::Byte
+  };
+
+  static bool fitsInt8(int64_t value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+  }
+
+  static bool fitsInt32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+  }
+
+  namespace {
+    class Encoder {
+    private:
+      std::vector<uint8_t> &out;
+      std::vector<Relocation> &relocations;
+      size_t blockBegin;
+      std::string_view source;
+
+      static uint8_t number(Reg r) {
+        return REG_NUMBERS[static_cast<size_t>(r)];
+      }
+
+      static Size size(const Operand &op) {
+        return op.kind == Operand::Kind::Reg ? REG_SIZES[static_cast<size_t>(op.reg)] : op.size;
+      }
+
+      static bool isReg(const Operand &op) {
+        return op.kind == Operand::Kind::Reg;
+      }
+
+      static bool isAddress(const Operand &op) {
+        return op.kind == Operand::Kind::Symbol || op.kind == Operand::Kind::StringLiteral;
+      }
+
+      bool isImmediate(const Operand &op) {
+        return op.kind == Operand::Kind::Imm || op.kind == Operand::Kind::Text;
+      }
+
+      // Text is a number as written in the source, or a string constant:
+      // a number made of its characters, the first one in the lowest byte,
+      // as in NASM
+      int64_t immediate(const Operand &op) {
+        if(op.kind == Operand::Kind::Imm)
+          return op.value;
+
+        std::string_view text = source.substr(static_cast<size_t>(op.value), op.length);
+        uint64_t number = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+
+        if(error == std::errc() && end == text.data() + text.size())
+          return static_cast<int64_t>(number);
+
+        if(text.size() < 2 || (text.front() != '"' && text.front() != '\'') || text.size() - 2 > 8)
+          throw EncodeError("'" + std::string(text) + "' isn't a numeric constant");
+
+        uint64_t value = 0;
+
+        for(size_t i = text.size() - 2; i > 0; --i)
+          value = value << 8 | static_cast<uint8_t>(text[i]);
+
+        return static_cast<int64_t>(value);
+      }
+
+      void byte(uint8_t value) {
+        out.push_back(value);
+      }
+
+      void bytes(std::initializer_list<uint8_t> values) {
+        out.insert(out.end(), values);
+      }
+
+      void imm8(int64_t value) {
+        byte(static_cast<uint8_t>(value));
+      }
+
+      void imm32(int64_t value) {
+        for(int i = 0; i < 4; ++i)
+          byte(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8)));
+      }
+
+      void imm64(int64_t value) {
+        for(int i = 0; i < 8; ++i)
+          byte(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8)));
+      }
+
+      void relocation(RelocationType type, const Operand &target, int64_t addend) {
+        relocations.push_back({ out.size() - blockBegin, type, target, addend });
+      }
+
+      void rex(bool wide, uint8_t reg, uint8_t index, uint8_t base) {
+        uint8_t prefix = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | (reg >> 3) << 2 | (index >> 3) << 1 | base >> 3);
+
+        if(prefix != 0x40)
+          byte(prefix);
+      }
+
+      // An opcode with a ModRM byte: reg is the register or the opcode
+      // extension of the reg field, rm a register or a memory operand
+      void modrm(bool wide, std::initializer_list<uint8_t> opcode, uint8_t reg, const Operand &rm) {
+        if(isReg(rm)) {
+          uint8_t base = number(rm.reg);
+
+          rex(wide, reg, 0, base);
+          bytes(opcode);
+          byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (base & 7)));
+          return;
+        }
+
+        if(rm.kind != Operand::Kind::Mem)
+          throw EncodeError("Expected a register or memory operand");
+
+        // An absolute address, taken from the symbol by the linker
+        if(rm.reg == Reg::None) {
+          Operand target = rm;
+          target.kind = Operand::Kind::Symbol;
+
+          rex(wide, reg, 0, 0);
+          bytes(opcode);
+          byte(static_cast<uint8_t>(0x04 | (reg & 7) << 3));
+          byte(0x25);
+          relocation(RelocationType::Abs32S, target, 0);
+          imm32(0);
+          return;
+        }
+
+        uint8_t base = number(rm.reg);
+        uint8_t index = rm.index == Reg::None ? 4 : number(rm.index);
+        int64_t disp = rm.value;
+        uint8_t mod = disp == 0 && (base & 7) != 5 ? 0 : fitsInt8(disp) ? 1 : 2;
+
+        if(!fitsInt32(disp))
+          throw EncodeError("Displacement out of range");
+
+        rex(wide, reg, index, base);
+        bytes(opcode);
+
+        if(rm.index == Reg::None && (base & 7) != 4) {
+          byte(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (base & 7)));
+        } else {
+          uint8_t scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+
+          byte(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | 4));
+          byte(static_cast<uint8_t>(scale << 6 | (index & 7) << 3 | (base & 7)));
+        }
+
+        if(mod == 1)
+          imm8(disp);
+        else if(mod == 2)
+          imm32(disp);
+      }
+
+      void mov(const Operand &dst, const Operand &src) {
+        if(isReg(dst) && isImmediate(src)) {
+          uint8_t r = number(dst.reg);
+          int64_t value = immediate(src);
+
+          if(size(dst) == Size::Byte) {
+            byte(static_cast<uint8_t>(0xB0 + r));
+            imm8(value);
+          } else if(size(dst) == Size::Dword || (value >= 0 && value <= UINT32_MAX)) {
+            // Writing the low half clears the high one
+            rex(false, 0, 0, r);
+            byte(static_cast<uint8_t>(0xB8 + (r & 7)));
+            imm32(value);
+          } else if(fitsInt32(value)) {
+            modrm(true, { 0xC7 }, 0, dst);
+            imm32(value);
+          } else {
+            rex(true, 0, 0, r);
+            byte(static_cast<uint8_t>(0xB8 + (r & 7)));
+            imm64(value);
+          }
+        } else if(isReg(dst) && isAddress(src)) {
+          uint8_t r = number(dst.reg);
+
+          rex(true, 0, 0, r);
+          byte(static_cast<uint8_t>(0xB8 + (r & 7)));
+          relocation(RelocationType::Abs64, src, 0);
+          imm64(0);
+        } else if(isReg(src)) {
+          modrm(size(src) == Size::Qword, { static_cast<uint8_t>(size(src) == Size::Byte ? 0x88 : 0x89) }, number(src.reg), dst);
+        } else if(isReg(dst)) {
+          modrm(size(dst) == Size::Qword, { static_cast<uint8_t>(size(dst) == Size::Byte ? 0x8A : 0x8B) }, number(dst.reg), src);
+        } else {
+          throw EncodeError("Unsupported operands of mov");
+        }
+      }
+
+      void movzx(const Operand &dst, const Operand &src) {
+        if(!isReg(dst))
+          throw EncodeError("Unsupported operands of movzx");
+
+        switch(size(src)) {
+        case Size::Byte:
+          modrm(size(dst) == Size::Qword, { 0x0F, 0xB6 }, number(dst.reg), src);
+          break;
+
+        case Size::Word:
+          modrm(size(dst) == Size::Qword, { 0x0F, 0xB7 }, number(dst.reg), src);
+          break;
+
+        // There is no movzx from 32 bits; a 32-bit mov zero-extends
+        case Size::Dword:
+          modrm(false, { 0x8B }, number(dst.reg), src);
+          break;
+
+        default:
+          throw EncodeError("Unsupported operands of movzx");
+        }
+      }
+
+      // add, or, and, sub and cmp, told apart by digit
+      void arithmetic(uint8_t digit, const Operand &dst, const Operand &src) {
+        bool wide = size(dst) == Size::Qword;
+        bool byteSized = size(dst) == Size::Byte;
+
+        if(isImmediate(src)) {
+          int64_t value = immediate(src);
+
+          if(byteSized && isReg(dst) && number(dst.reg) == 0) {
+            byte(static_cast<uint8_t>(digit << 3 | 4));
+            imm8(value);
+          } else if(byteSized) {
+            modrm(false, { 0x80 }, digit, dst);
+            imm8(value);
+          } else if(fitsInt8(value)) {
+            modrm(wide, { 0x83 }, digit, dst);
+            imm8(value);
+          } else if(!fitsInt32(value)) {
+            throw EncodeError("Immediate out of range");
+          } else if(isReg(dst) && number(dst.reg) == 0) {
+            rex(wide, 0, 0, 0);
+            byte(static_cast<uint8_t>(digit << 3 | 5));
+            imm32(value);
+          } else {
+            modrm(wide, { 0x81 }, digit, dst);
+            imm32(value);
+          }
+        } else if(isReg(src)) {
+          modrm(size(src) == Size::Qword, { static_cast<uint8_t>(digit << 3 | (byteSized ? 0 : 1)) }, number(src.reg), dst);
+        } else if(isReg(dst)) {
+          modrm(wide, { static_cast<uint8_t>(digit << 3 | (byteSized ? 2 : 3)) }, number(dst.reg), src);
+        } else {
+          throw EncodeError("Unsupported operands");
+        }
+      }
+
+      // mul, imul and idiv of the accumulator, and dec, told apart by digit
+      void unary(uint8_t opcode, uint8_t digit, const Operand &op) {
+        bool byteSized = size(op) == Size::Byte;
+        modrm(size(op) == Size::Qword, { static_cast<uint8_t>(byteSized ? opcode - 1 : opcode) }, digit, op);
+      }
+
+      void push(const Operand &op) {
+        if(isReg(op)) {
+          uint8_t r = number(op.reg);
+
+          rex(false, 0, 0, r);
+          byte(static_cast<uint8_t>(0x50 + (r & 7)));
+        } else if(isImmediate(op)) {
+          int64_t value = immediate(op);
+
+          if(fitsInt8(value)) {
+            byte(0x6A);
+            imm8(value);
+          } else if(fitsInt32(value)) {
+            byte(0x68);
+            imm32(value);
+          } else {
+            throw EncodeError("Immediate out of range");
+          }
+        } else {
+          throw EncodeError("Unsupported operand of push");
+        }
+      }
+
+      void pop(const Operand &op) {
+        if(!isReg(op))
+          throw EncodeError("Unsupported operand of pop");
+
+        uint8_t r = number(op.reg);
+
+        rex(false, 0, 0, r);
+        byte(static_cast<uint8_t>(0x58 + (r & 7)));
+      }
+
+    public:
+      Encoder(std::vector<uint8_t> &out_, std::vector<Relocation> &relocations_, size_t blockBegin_, std::string_view source_)
+        : out(out_), relocations(relocations_), blockBegin(blockBegin_), source(source_) {}
+
+      void encode(const Instruction &i) {
+        const Operand &a = i.operands[0];
+        const Operand &b = i.operands[1];
+
+        switch(i.opcode) {
+        case Opcode::Nop:
+        case Opcode::Label:
+          break;
+
+        case Opcode::Mov: mov(a, b); break;
+        case Opcode::Movzx: movzx(a, b); break;
+        case Opcode::Add: arithmetic(0, a, b); break;
+        case Opcode::Or: arithmetic(1, a, b); break;
+        case Opcode::And: arithmetic(4, a, b); break;
+        case Opcode::Sub: arithmetic(5, a, b); break;
+        case Opcode::Cmp: arithmetic(7, a, b); break;
+        case Opcode::Mul: unary(0xF7, 4, a); break;
+        case Opcode::Idiv: unary(0xF7, 7, a); break;
+        case Opcode::Dec: unary(0xFF, 1, a); break;
+
+        case Opcode::Imul:
+          if(b.kind == Operand::Kind::None)
+            unary(0xF7, 5, a);
+          else
+            modrm(size(a) == Size::Qword, { 0x0F, 0xAF }, number(a.reg), b);
+
+          break;
+
+        case Opcode::Sete: modrm(false, { 0x0F, 0x94 }, 0, a); break;
+        case Opcode::Setne: modrm(false, { 0x0F, 0x95 }, 0, a); break;
+        case Opcode::Setl: modrm(false, { 0x0F, 0x9C }, 0, a); break;
+        case Opcode::Setge: modrm(false, { 0x0F, 0x9D }, 0, a); break;
+        case Opcode::Setle: modrm(false, { 0x0F, 0x9E }, 0, a); break;
+        case Opcode::Setg: modrm(false, { 0x0F, 0x9F }, 0, a); break;
+        case Opcode::Push: push(a); break;
+        case Opcode::Pop: pop(a); break;
+
+        case Opcode::Call:
+          byte(0xE8);
+          relocation(RelocationType::Pc32, a, -4);
+          imm32(0);
+          break;
+
+        case Opcode::Ret:
+          byte(0xC3);
+          break;
+
+        case Opcode::Raw:
+          throw EncodeError("Inline assembly can't be encoded");
+
+        case Opcode::Jmp:
+        case Opcode::Je:
+        case Opcode::Jle:
+          throw EncodeError("A jump in the middle of a block");
+        }
+      }
+    };
+
+    class LabelKey {
+    public:
+      int64_t id;
+      uint8_t kind;
+
+      bool operator ==(const LabelKey &other) const {
+        return id == other.id && kind == other.kind;
+      }
+    };
+
+    class LabelKeyHash {
+    public:
+      size_t operator ()(const LabelKey &key) const {
+        return std::hash<int64_t>()(key.id) ^ key.kind;
+      }
+    };
+  }
+
+  void MachineCode::encode(const Code &code, size_t first, size_t last, std::string_view source) {
+    auto &codeBlocks = code.getBlocks();
+
+    if(blocks.size() < last)
+      blocks.resize(last);
+
+    for(size_t b = first; b < last; ++b) {
+      EncodedBlock &block = blocks[b];
+      auto &instructions = codeBlocks[b].instructions;
+      Encoder encoder(scratch, scratchRelocations, scratch.size(), source);
+
+      block.begin = scratch.size();
+      block.firstRelocation = scratchRelocations.size();
+
+      for(auto &i : instructions) {
+        if(i.opcode == Opcode::Label && i.operands[0].kind == Operand::Kind::Label) {
+          block.label = i.operands[0];
+        } else if(i.opcode == Opcode::Jmp || i.opcode == Opcode::Je || i.opcode == Opcode::Jle) {
+          if(&i != &instructions.back())
+            throw EncodeError("A jump in the middle of a block");
+
+          block.jump = i.opcode;
+          block.target = i.operands[0];
+        } else {
+          encoder.encode(i);
+        }
+      }
+
+      block.end = scratch.size();
+      block.lastRelocation = scratchRelocations.size();
+    }
+  }
+
+  void MachineCode::finish() {
+    std::unordered_map<LabelKey, size_t, LabelKeyHash> labels;
+    std::vector<size_t> targets(blocks.size());
+    std::vector<char> near(blocks.size(), false);
+    std::vector<size_t> offsets(blocks.size() + 1);
+
+    for(size_t b = 0; b < blocks.size(); ++b)
+      if(blocks[b].label.kind == Operand::Kind::Label)
+        labels[{ blocks[b].label.value, blocks[b].label.flags }] = b;
+
+    for(size_t b = 0; b < blocks.size(); ++b) {
+      if(blocks[b].jump == Opcode::Nop)
+        continue;
+
+      auto target = labels.find({ blocks[b].target.value, blocks[b].target.flags });
+
+      if(target == labels.end())
+        throw EncodeError("Jump to an undefined label");
+
+      targets[b] = target->second;
+    }
+
+    auto jumpSize = [&](size_t b) -> size_t {
+      if(blocks[b].jump == Opcode::Nop)
+        return 0;
+
+      if(!near[b])
+        return 2;
+
+      return blocks[b].jump == Opcode::Jmp ? 5 : 6;
+    };
+
+    // Every jump starts short and is made near while it doesn't reach;
+    // jumps only grow, so this ends
+    for(bool changed = true; changed;) {
+      changed = false;
+
+      for(size_t b = 0; b < blocks.size(); ++b)
+        offsets[b + 1] = offsets[b] + (blocks[b].end - blocks[b].begin) + jumpSize(b);
+
+      for(size_t b = 0; b < blocks.size(); ++b) {
+        if(blocks[b].jump == Opcode::Nop || near[b])
+          continue;
+
+        int64_t distance = static_cast<int64_t>(offsets[targets[b]]) - static_cast<int64_t>(offsets[b + 1]);
+
+        if(!fitsInt8(distance)) {
+          near[b] = true;
+          changed = true;
+        }
+      }
+    }
+
+    bytes.reserve(offsets.back());
+
+    for(size_t b = 0; b < blocks.size(); ++b) {
+      EncodedBlock &block = blocks[b];
+
+      for(size_t r = block.firstRelocation; r < block.lastRelocation; ++r) {
+        Relocation relocation = scratchRelocations[r];
+        relocation.offset += bytes.size();
+        relocations.push_back(relocation);
+      }
+
+      bytes.insert(bytes.end(), scratch.begin() + static_cast<ptrdiff_t>(block.begin),
+                   scratch.begin() + static_cast<ptrdiff_t>(block.end));
+
+      if(block.jump == Opcode::Nop)
+        continue;
+
+      int64_t distance = static_cast<int64_t>(offsets[targets[b]]) - static_cast<int64_t>(offsets[b + 1]);
+
+      if(!near[b]) {
+        bytes.push_back(block.jump == Opcode::Jmp ? 0xEB : block.jump == Opcode::Je ? 0x74 : 0x7E);
+        bytes.push_back(static_cast<uint8_t>(distance));
+        continue;
+      }
+
+      if(block.jump == Opcode::Jmp) {
+        bytes.push_back(0xE9);
+      } else {
+        bytes.push_back(0x0F);
+        bytes.push_back(block.jump == Opcode::Je ? 0x84 : 0x8E);
+      }
+
+      for(int i = 0; i < 4; ++i)
+        bytes.push_back(static_cast<uint8_t>(static_cast<uint64_t>(distance) >> (i * 8)));
+    }
+
+    std::vector<EncodedBlock>().swap(blocks);
+    std::vector<uint8_t>().swap(scratch);
+    std::vector<Relocation>().swap(scratchRelocations);
+  }
+}
@@ -0,0 +1,128 @@
+#include "mir.hpp"
+#include <array>
+
+namespace MIR {
+  static const std::array<std::string_view, 27> OPCODE_NAMES = {
+    "", "", "",
+    "mov", "movzx", "add", "sub", "imul", "mul", "idiv", "cmp", "and", "or",
+    "sete", "setne", "setg", "setl", "setge", "setle",
+    "push", "pop", "dec", "call", "jmp", "je", "jle", "ret"
+  };
+
+  static const std::array<std::string_view, 8> LABEL_NAMES = {
+    ".endif_", ".endelse_", ".beginwhile_", ".endwhile_", ".beginfor_", ".endfor_", ".pow_", ".endpow_"
+  };
+
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  static std::string_view span(std::string_view source, const Operand &op) {
+    return source.substr(static_cast<size_t>(op.value), op.length);
+  }
+
+  static void printOperand(const Operand &op, std::string_view source, std::string_view scope, OutputBuffer &out) {
+    switch(op.kind) {
+    case Operand::Kind::None:
+      break;
+
+    case Operand::Kind::Reg:
+      out << regName(op.reg);
+      break;
+
+    case Operand::Kind::Imm:
+      if(op.flags != 0) {
+        auto value = static_cast<uint64_t>(op.value);
+        out << "0x" << HEX_DIGITS[(value >> 4) & 0xf] << HEX_DIGITS[value & 0xf];
+      } else {
+        out << op.value;
+      }
+
+      break;
+
+    case Operand::Kind::Mem:
+      out << sizeName(op.size) << '[';
+
+      if(op.reg == Reg::None) {
+        out << span(source, op);
+      } else {
+        out << regName(op.reg);
+
+        if(op.index != Reg::None) {
+          out << '+' << regName(op.index);
+
+          if(op.scale != 1)
+            out << '*' << op.scale;
+        }
+
+        if(op.value < 0)
+          out << '-' << -op.value;
+        else if(op.value > 0)
+          out << '+' << op.value;
+      }
+
+      out << ']';
+      break;
+
+    case Operand::Kind::Symbol:
+    case Operand::Kind::Text:
+      out << span(source, op);
+      break;
+
+    case Operand::Kind::Label:
+      out << LABEL_NAMES[op.flags] << op.value;
+      break;
+
+    case Operand::Kind::StringLiteral:
+      out << "__string_literal_";
+
+      if(!scope.empty())
+        out << scope << '_';
+
+      out << op.value;
+      break;
+    }
+  }
+
+  void print(const Code &code, std::string_view source, std::string_view scope, OutputBuffer &out) {
+    print(code, 0, code.getBlocks().size(), source, scope, out);
+  }
+
+  void print(const Code &code, size_t first, size_t last,
+             std::string_view source, std::string_view scope, OutputBuffer &out) {
+    auto &blocks = code.getBlocks();
+
+    for(size_t b = first; b < last; ++b) {
+      for(auto &i : blocks[b].instructions) {
+        switch(i.opcode) {
+        case Opcode::Nop:
+          continue;
+
+        case Opcode::Label:
+          printOperand(i.operands[0], source, scope, out);
+          out << ":\n";
+          continue;
+
+        case Opcode::Raw:
+          out << code.getRawText(static_cast<size_t>(i.operands[0].value)) << '\n';
+          continue;
+
+        default:
+          break;
+        }
+
+        out << OPCODE_NAMES[static_cast<size_t>(i.opcode)];
+
+        if(i.operands[0].kind != Operand::Kind::None) {
+          out << ' ';
+          printOperand(i.operands[0], source, scope, out);
+        }
+
+        if(i.operands[1].kind != Operand::Kind::None) {
+          out << ", ";
+          printOperand(i.operands[1], source, scope, out);
+        }
+
+        out << '\n';
+      }
+    }
+  }
+}
@@ -0,0 +1,154 @@
+#include "output_buffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Chunks start small, as most functions are, and double up to the cap
+static constexpr size_t FIRST_CHUNK_SIZE = 256;
+static constexpr size_t MAX_CHUNK_SIZE = 64 << 10;
+
+OutputBuffer::OutputBuffer()
+  : cursor(nullptr), limit(nullptr), nextChunkSize(FIRST_CHUNK_SIZE), total(0) {}
+
+OutputBuffer::OutputBuffer(OutputBuffer &&other) noexcept
+  : chunks(std::move(other.chunks)), cursor(other.cursor), limit(other.limit),
+    nextChunkSize(other.nextChunkSize), total(other.total) {
+  other.chunks.clear();
+  other.clear();
+}
+
+OutputBuffer &OutputBuffer::operator =(OutputBuffer &&other) noexcept {
+  if(this != &other) {
+    chunks = std::move(other.chunks);
+    cursor = other.cursor;
+    limit = other.limit;
+    nextChunkSize = other.nextChunkSize;
+    total = other.total;
+    other.chunks.clear();
+    other.clear();
+  }
+
+  return *this;
+}
+
+// The size of the current chunk is only recorded when it is left, which
+// keeps appending down to a bounds check and a copy
+void OutputBuffer::grow(size_t minSize) {
+  if(!chunks.empty())
+    chunks.back().size = static_cast<size_t>(cursor - chunks.back().data.get());
+
+  size_t size = std::max(nextChunkSize, minSize);
+
+  chunks.push_back({ std::make_unique<char[]>(size), 0 });
+  cursor = chunks.back().data.get();
+  limit = cursor + size;
+  nextChunkSize = std::min(nextChunkSize * 2, MAX_CHUNK_SIZE);
+}
+
+void OutputBuffer::append(const char *text, size_t length) {
+  size_t room = static_cast<size_t>(limit - cursor);
+
+  if(room != 0) {
+    std::memcpy(cursor, text, room);
+    cursor += room;
+    text += room;
+    length -= room;
+    total += room;
+  }
+
+  grow(length);
+  std::memcpy(cursor, text, length);
+  cursor += length;
+  total += length;
+}
+
+OutputBuffer &OutputBuffer::operator <<(OutputBuffer &&other) {
+  if(other.chunks.empty())
+    return *this;
+
+  if(!chunks.empty())
+    chunks.back().size = static_cast<size_t>(cursor - chunks.back().data.get());
+
+  for(auto &i : other.chunks)
+    chunks.push_back(std::move(i));
+
+  cursor = other.cursor;
+  limit = other.limit;
+  nextChunkSize = std::max(nextChunkSize, other.nextChunkSize);
+  total += other.total;
+
+  other.chunks.clear();
+  other.clear();
+
+  return *this;
+}
+
+size_t OutputBuffer::size() const {
+  return total;
+}
+
+bool OutputBuffer::empty() const {
+  return total == 0;
+}
+
+void OutputBuffer::clear() {
+  chunks.clear();
+  cursor = limit = nullptr;
+  nextChunkSize = FIRST_CHUNK_SIZE;
+  total = 0;
+}
+
+void OutputBuffer::appendTo(std::string &text) const {
+  text.reserve(text.size() + total);
+
+  for(size_t i = 0; i < chunks.size(); ++i) {
+    size_t size = i + 1 == chunks.size()
+      ? static_cast<size_t>(cursor - chunks[i].data.get())
+      : chunks[i].size;
+
+    text.append(chunks[i].data.get(), size);
+  }
+}
+
+bool OutputBuffer::writeTo(int fd) {
+  if(!chunks.empty())
+    chunks.back().size = static_cast<size_t>(cursor - chunks.back().data.get());
+
+  std::vector<iovec> vectors;
+
+  for(auto &i : chunks)
+    if(i.size != 0)
+      vectors.push_back({ i.data.get(), i.size });
+
+  for(size_t first = 0; first < vectors.size(); ) {
+    int count = static_cast<int>(std::min<size_t>(vectors.size() - first, IOV_MAX));
+    ssize_t written = writev(fd, vectors.data() + first, count);
+
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+
+      return false;
+    }
+
+    // A short write leaves the rest of the vectors for the next call
+    for(size_t left = static_cast<size_t>(written); left != 0; ) {
+      iovec &v = vectors[first];
+
+      if(left >= v.iov_len) {
+        left -= v.iov_len;
+        ++first;
+      } else {
+        v.iov_base = static_cast<char*>(v.iov_base) + left;
+        v.iov_len -= left;
+        left = 0;
+      }
+    }
+  }
+
+  clear();
+
+  return true;
+}
@@ -1,10 +1,9 @@
 #include "AST.hpp"
+#include <algorithm>
+#include <array>
 #include "lexer_token.hpp"
 #include <string>
 #include <type_traits>
-#include <unordered_map>
-#include <stack>
-#include <functional>
 #include <iostream>
 #include <utility>
 #include <vector>
@@ -13,28 +12,48 @@
 using namespace std;
 using namespace AST;
 
-static unordered_map<Lexer::OperatorType, size_t> OPERATION_PRIORITY = {
-  { Lexer::OperatorType::Or,              1 },
-  { Lexer::OperatorType::And,             1 },
-  { Lexer::OperatorType::NotEquals,       2 },
-  { Lexer::OperatorType::Equals,          2 },
-  { Lexer::OperatorType::More,            2 },
-  { Lexer::OperatorType::Less,            2 },
-  { Lexer::OperatorType::Plus,            3 },
-  { Lexer::OperatorType::Minus,           3 },
-  { Lexer::OperatorType::Multiply,        4 },
-  { Lexer::OperatorType::Divide,          4 },
-  { Lexer::OperatorType::Percent,         4 },
-  { Lexer::OperatorType::Assign,          0 }
+struct BinaryOperator {
+  uint8_t precedence; // 0 for tokens that aren't binary operators
+  bool rightAssociative;
 };
 
+constexpr std::array<BinaryOperator, 256> makeBinaryOperatorTable() {
+  std::array<BinaryOperator, 256> table{};
+  auto set = [&table](Lexer::OperatorType op, uint8_t precedence, bool right = false) {
+    table[static_cast<size_t>(op)] = { precedence, right };
+  };
+
+  set(Lexer::OperatorType::Assign,       1, true);
+  set(Lexer::OperatorType::Or,           2);
+  set(Lexer::OperatorType::And,          2);
+  set(Lexer::OperatorType::BinOr,        3);
+  set(Lexer::OperatorType::BinAnd,       4);
+  set(Lexer::OperatorType::Equals,       5);
+  set(Lexer::OperatorType::NotEquals,    5);
+  set(Lexer::OperatorType::More,         5);
+  set(Lexer::OperatorType::Less,         5);
+  set(Lexer::OperatorType::MoreOrEquals, 5);
+  set(Lexer::OperatorType::LessOrEquals, 5);
+  set(Lexer::OperatorType::Plus,         6);
+  set(Lexer::OperatorType::Minus,        6);
+  set(Lexer::OperatorType::Multiply,     7);
+  set(Lexer::OperatorType::Divide,       7);
+  set(Lexer::OperatorType::Percent,      7);
+  set(Lexer::OperatorType::Pow,          8, true);
+
+  return table;
+}
+
+static constexpr std::array<BinaryOperator, 256> BINARY_OPERATORS = makeBinaryOperatorTable();
+
 static std::string LEXER_TYPENAMES[] = {
   "integer",
   "float",
   "string",
   "identifier",
   "char",
-  "operator"
+  "operator",
+  "end of file"
 };
 
 static std::string LEXER_OPERATORS[] = {
@@ -44,55 +63,80 @@ static std::string LEXER_OPERATORS[] = {
   ";",    ":", ",", "=>", "++", "--"
 };
 
-static unordered_map<std::string, bool> KEYWORDS = {
-  { "var", true },
-  { "if", true },
-  { "while", true },
-  { "for", true },
-  { "fn", true },
-};
+// Keywords that can't be used as variable or function names
+static inline bool isReserved(Lexer::Keyword kw) {
+  return
+    kw == Lexer::Keyword::Var   ||
+    kw == Lexer::Keyword::If    ||
+    kw == Lexer::Keyword::While ||
+    kw == Lexer::Keyword::For   ||
+    kw == Lexer::Keyword::Fn;
+}
 
 namespace Parser {
 
-Error::Error(Lexer::Token &tok, std::string err) : token(tok), error(err){};
+Error::Error(const Lexer::Token &tok, std::string err) : offset(tok.offset), error(err){};
+Error::Error(size_t off, std::string err) : offset(off), error(err){};
+
+Parser::Parser(Lexer::TokenStream &toks, std::string_view source_, bool parseAll)
+    : tokens(toks), current(0), source(source_) {
+  if(!parseAll)
+    return;
 
-Parser::Parser(Lexer::TokenList &toks)
-    : tokens(toks), current(tokens.begin()), stmts(toks[0]) {
-  while (current != tokens.end())
-    stmts.addNode(parseStatement());
+  while (peek().type != Lexer::Type::EndOfFile)
+    pending.push_back(parseStatement());
+
+  stmts = collect(0);
+  }
+
+  NodeId Parser::parseDeclaration() {
+    if(peek().type == Lexer::Type::EndOfFile)
+      return NodeId();
+
+    return parseStatement();
+  }
+
+  // Children are gathered on the pending stack while their list is parsed
+  // and moved into the arena in one piece once it is complete
+  NodeList Parser::collect(size_t base) {
+    NodeList list = tree.list(pending.data() + base, pending.size() - base);
+
+    pending.resize(base);
+
+    return list;
   }
   
   void Parser::match(string l) {
-    if(current == tokens.end())
-      throw Error(*(current - 1), "Unexpected end of file");
+    if(peek().type == Lexer::Type::EndOfFile)
+      throw Error(at(current - 1), "Unexpected end of file");
 
-    if(current->value != l)
-      throw Error(*current, "Expected '" + l + "' instead of '" + current->value + "'");
+    if(peek().value(source) != l)
+      throw Error(at(current), "Expected '" + l + "' instead of '" + string(peek().value(source)) + "'");
 
     next();
   }
 
-  Lexer::Token &Parser::match(Lexer::Type t) {
-    if(current == tokens.end())
-      throw Error(*(current - 1), "Unexpected end of file");
+  Lexer::Token Parser::match(Lexer::Type t) {
+    if(peek().type == Lexer::Type::EndOfFile)
+      throw Error(at(current - 1), "Unexpected end of file");
 
-    if(current->type != t)
-      throw Error(*current, "Expected '" + LEXER_TYPENAMES[(size_t)t] + "' instead of '" + current->value + '\'');
+    if(peek().type != t)
+      throw Error(at(current), "Expected '" + LEXER_TYPENAMES[(size_t)t] + "' instead of '" + string(peek().value(source)) + '\'');
 
-    Lexer::Token &tok = *current;
+    Lexer::Token tok = at(current);
     next();
 
     return tok;
   }
 
-  Lexer::Token &Parser::match(Lexer::OperatorType ot) {
-    if(current == tokens.end())
-      throw Error(*(current - 1), "Unexpected end of file");
+  Lexer::Token Parser::match(Lexer::OperatorType ot) {
+    if(peek().type == Lexer::Type::EndOfFile)
+      throw Error(at(current - 1), "Unexpected end of file");
     
-    if(current->operatorType != ot)
-      throw Error(*current, "Expected '" + LEXER_OPERATORS[(size_t)ot] + "' instead of '" + current->value + '\'');
+    if(peek().operatorType != ot)
+      throw Error(at(current), "Expected '" + LEXER_OPERATORS[(size_t)ot] + "' instead of '" + string(peek().value(source)) + '\'');
 
-    Lexer::Token &tok = *current;
+    Lexer::Token tok = at(current);
     next();
 
     return tok;
@@ -102,180 +146,180 @@ Parser::Parser(Lexer::TokenList &toks)
     ++current;
   }
 
-  FunctionNode *Parser::parseFunction() {
+  const Lexer::Token &Parser::peek() {
+    return tokens.at(current);
+  }
+
+  Lexer::Token Parser::at(size_t index) {
+    return tokens.at(index);
+  }
+
+  NodeId Parser::parseFunction() {
     auto begin = current;
+    Lexer::Token first = peek();
     bool isExtern = true;
     
-    if(current->value == "static") {
+    if(peek().keyword() == Lexer::Keyword::Static) {
       isExtern = false;
       next();
     }
     
-    if(current->value != "fn") {
+    if(peek().keyword() != Lexer::Keyword::Fn) {
       current = begin;
-      return nullptr;
+      return NodeId();
     }
 
     next();
 
-    Lexer::Token &id = match(Lexer::Type::Identifier);
-    ParametersNode *params = parseParameters();
+    Lexer::Token id = match(Lexer::Type::Identifier);
+    NodeId params = parseParameters();
     match(Lexer::OperatorType::Colon);
-    pair<vector<Node*>, Lexer::Token&> type = parseType();
+    pair<NodeList, Lexer::Token> type = parseType();
 
-    if(current->operatorType != Lexer::OperatorType::Assign)
-      return new FunctionNode(type.second, type.first, id, params, nullptr, isExtern, *begin);
+    if(peek().operatorType != Lexer::OperatorType::Assign)
+      return make<FunctionNode>(type.second, getType(type), type.first, id, params, NodeId(), isExtern, first);
 
     next();
-    Node *body = parseStatements();
+    NodeId body = parseStatements();
 
-    if(body == nullptr)
+    if(!body)
       body = parseFormula();
     
-    return new FunctionNode(type.second, type.first, id, params, body, isExtern, *begin);
+    return make<FunctionNode>(type.second, getType(type), type.first, id, params, body, isExtern, first);
   }
   
-  StatementsNode *Parser::parseStatements() {
-    auto begin = current;
+  NodeId Parser::parseStatements() {
+    Lexer::Token first = peek();
     
-    if(current->operatorType != Lexer::OperatorType::LeftFigureParen)
-      return nullptr;
+    if(peek().operatorType != Lexer::OperatorType::LeftFigureParen)
+      return NodeId();
 
     next();
     
-    StatementsNode *statements = new StatementsNode(*begin);
+    size_t base = pending.size();
 
-    while(current->operatorType != Lexer::OperatorType::RightFigureParen)
-      statements->addNode(parseStatement());
+    while(peek().operatorType != Lexer::OperatorType::RightFigureParen)
+      pending.push_back(parseStatement());
 
-    try {
-      match(Lexer::OperatorType::RightFigureParen);
-    } catch(Error &e) {
-      delete statements;
-
-      throw e;
-    }
+    match(Lexer::OperatorType::RightFigureParen);
     
-    return statements;
+    return make<StatementsNode>(first, collect(base));
   }
 
-  Node *Parser::parseReturn() {
-    auto begin = current;
-    
-    if(current->operatorType != Lexer::OperatorType::HardArrowRight)
-      return nullptr;
+  NodeId Parser::parseReturn() {
+    if(peek().operatorType != Lexer::OperatorType::HardArrowRight)
+      return NodeId();
 
-    Lexer::Token &op = *current;
+    Lexer::Token op = at(current);
     next();
     
-    return new UnaryNode(op, parseFormula(), *begin);
+    return make<UnaryNode>(op, parseFormula());
   }
   
-  Node *Parser::parseStatement() {
-    Node *expr = nullptr;
-
-    if((expr = parseVariableDeclaration()) != nullptr ||
-       (expr = parseFunction())            != nullptr ||
-       (expr = parseReturn())              != nullptr ||
-       (expr = parseFormula())             != nullptr ||
-       (expr = parseIfStatement())         != nullptr ||
-       (expr = parseForStatement())        != nullptr ||
-       (expr = parseWhileStatement())      != nullptr) {
-      try {
-        if(expr->type != NodeType::IfStatement &&
-           expr->type != NodeType::WhileStatement)
-          match(Lexer::OperatorType::Semicolon);
-      } catch (Error &e) {
-        if(expr != nullptr)
-          delete expr;
-
-        throw e;
-      }
+  NodeId Parser::parseStatement() {
+    NodeId expr;
+
+    // Parsing never backtracks past the beginning of a statement and nodes
+    // copy the tokens they need, so everything before it can be dropped;
+    // one token is kept for end-of-file errors
+    if(current != 0)
+      tokens.release(current - 1);
+
+    if((expr = parseVariableDeclaration()) ||
+       (expr = parseFunction())            ||
+       (expr = parseReturn())              ||
+       (expr = parseFormula())             ||
+       (expr = parseIfStatement())         ||
+       (expr = parseForStatement())        ||
+       (expr = parseWhileStatement())) {
+      if(expr.type() != NodeType::IfStatement &&
+         expr.type() != NodeType::WhileStatement)
+        match(Lexer::OperatorType::Semicolon);
 
       return expr;
     }
 
-    return nullptr;
+    return NodeId();
   }
 
-  Node *Parser::parseTypeModifier() {
-    Node *modifier = nullptr;
+  NodeId Parser::parseTypeModifier() {
+    NodeId modifier;
 
-    if(current->type != Lexer::Type::Identifier) {
-      if(current->operatorType == Lexer::OperatorType::At) {
-        modifier = new ValueNode(*current, *current);
+    if(peek().type != Lexer::Type::Identifier) {
+      if(peek().operatorType == Lexer::OperatorType::At) {
+        modifier = make<ValueNode>(at(current));
         next();
-      } else if(current->operatorType == Lexer::OperatorType::LeftSquareParen)
+      } else if(peek().operatorType == Lexer::OperatorType::LeftSquareParen)
         modifier = parseIndex();
     }
 
     return modifier;
   }
 
-  std::vector<AST::Node*> Parser::parseTypeModifiers() {
-    Node *modifier = nullptr;
-    vector<Node*> modifiers;
+  NodeList Parser::parseTypeModifiers() {
+    NodeId modifier;
+    size_t base = pending.size();
 
-    while((modifier = parseTypeModifier()) != nullptr)
-      modifiers.push_back(modifier);
+    while((modifier = parseTypeModifier()))
+      pending.push_back(modifier);
 
-    return modifiers;
+    return collect(base);
   }
 
-  pair<vector<Node*>, Lexer::Token&> Parser::parseType() {
-    vector<Node*> modifiers = parseTypeModifiers();
-    Lexer::Token *t = nullptr;
+  pair<NodeList, Lexer::Token> Parser::parseType() {
+    NodeList modifiers = parseTypeModifiers();
+    Lexer::Token name = match(Lexer::Type::Identifier);
 
-    try {
-      t = &match(Lexer::Type::Identifier);
-    } catch(Error &e) {
-      for(auto i : modifiers)
-        delete i;
-      
-      throw e;
-    }
+    return pair<NodeList, Lexer::Token>(modifiers, name);
+  }
+  
+  Type Parser::getType(const pair<NodeList, Lexer::Token> &type) {
+    if(type.first.size() > Type::MAX_POINTER_LEVEL)
+      throw Error(type.second, "Too many type modifiers");
 
-    return pair<vector<Node*>, Lexer::Token&>(modifiers, *t);
+    return Type(typeByName(type.second.value(source)), type.first.size(), type.first.size() != 0);
   }
   
-  VariableNode *Parser::parseVariableDeclaration() {
+  NodeId Parser::parseVariableDeclaration() {
     auto begin = current;
     bool isExtern = false;
     bool isDefined = false;
 
-    if(current->value == "extern") {
+    if(peek().keyword() == Lexer::Keyword::Extern) {
       isExtern = true;
       next();
     }
 
-    if(current->value == "def") {
+    if(peek().keyword() == Lexer::Keyword::Def) {
       isDefined = true;
       next();
     }
 
-    if(current->value != "var") {
-      return nullptr;
+    if(peek().keyword() != Lexer::Keyword::Var) {
+      return NodeId();
     }
 
     next();
-    Lexer::Token &id = match(Lexer::Type::Identifier);
+    Lexer::Token id = match(Lexer::Type::Identifier);
     match(Lexer::OperatorType::Colon);
 
-    pair<vector<Node *>, Lexer::Token&> type = parseType();
+    pair<NodeList, Lexer::Token> type = parseType();
 
-    if(current->operatorType != Lexer::OperatorType::Assign) {
-      auto newvar = new VariableNode(type.second, type.first, id, nullptr, isExtern, *begin);
-      newvar->isDefined = isDefined;
+    if(peek().operatorType != Lexer::OperatorType::Assign) {
+      NodeId newvar = make<VariableNode>(type.second, getType(type), type.first, id, NodeId(), isExtern, at(begin));
+      tree.variable(newvar).isDefined = isDefined;
 
       return newvar;
     }
 
     match(Lexer::OperatorType::Assign);
 
-    return new VariableNode(type.second, type.first, id, parseFormula(), isExtern, *begin);
+    NodeId value = parseFormula();
+
+    return make<VariableNode>(type.second, getType(type), type.first, id, value, isExtern, at(begin));
   }
   
-  static inline bool isValue(Lexer::Token &lex) {
+  static inline bool isValue(const Lexer::Token &lex) {
     return
       lex.type == Lexer::Type::Char    ||
       lex.type == Lexer::Type::Float   ||
@@ -283,361 +327,290 @@ Parser::Parser(Lexer::TokenList &toks)
       lex.type == Lexer::Type::String;
   }
   
-  ValueNode *Parser::parseValue() {
-    Lexer::Token &val = *current;
+  NodeId Parser::parseValue() {
+    Lexer::Token val = at(current);
     
-    if(isValue(*current)) {
+    if(isValue(at(current))) {
       next();
       
-      return new ValueNode(val, val);
+      return make<ValueNode>(val);
     }
 
-    return nullptr;
+    return NodeId();
   }
 
-  ValueNode *Parser::parseVariable() {
-    if(KEYWORDS.find(current->value) != KEYWORDS.end())
-      return nullptr;
+  NodeId Parser::parseVariable() {
+    if(isReserved(peek().keyword()))
+      return NodeId();
     
-    ValueNode *val;
+    NodeId val;
     
-    if(current->type == Lexer::Type::Identifier) {
-      val = new ValueNode(*current, *current);
+    if(peek().type == Lexer::Type::Identifier) {
+      val = make<ValueNode>(at(current));
       next();
 
       return val;
     }
 
-    throw Error(*current, "Expected identifier instead of '" + current->value + '\'');
+    throw Error(at(current), "Expected identifier instead of '" + string(peek().value(source)) + '\'');
   }
 
-  VariableNode *Parser::parseParameter() {
+  NodeId Parser::parseParameter() {
     
-    Lexer::Token &id = match(Lexer::Type::Identifier);
+    Lexer::Token id = match(Lexer::Type::Identifier);
     match(Lexer::OperatorType::Colon);
-    pair<vector<Node*>, Lexer::Token&> type = parseType();
+    pair<NodeList, Lexer::Token> type = parseType();
 
-    return new VariableNode(type.second, type.first, id, nullptr, false, id);
+    return make<VariableNode>(type.second, getType(type), type.first, id, NodeId(), false, id);
   }
 
-  Node *Parser::parseList(function<Node*()> parseElement) {
+  template<typename ParseElement>
+  NodeId Parser::parseList(ParseElement parseElement) {
     auto begin = current;
     
     match(Lexer::OperatorType::LeftParen);
     
-    ParametersNode *parameters = new ParametersNode(*begin);
+    size_t base = pending.size();
     
-    while(current->operatorType != Lexer::OperatorType::RightParen) {
-      parameters->addParameter(parseElement());
+    while(peek().operatorType != Lexer::OperatorType::RightParen) {
+      pending.push_back(parseElement());
       
-      if(current->operatorType == Lexer::OperatorType::Comma) {
+      if(peek().operatorType == Lexer::OperatorType::Comma) {
         next();
         continue;
       }
 
-      if(current->operatorType == Lexer::OperatorType::RightParen) {
-        next();
-        return parameters;
-      }
+      if(peek().operatorType == Lexer::OperatorType::RightParen)
+        break;
 
-      throw Error(*current, "Unexpected token '" + current->value + '\'');
+      throw Error(at(current), "Unexpected token '" + string(peek().value(source)) + '\'');
     }
     
     next();
-    return parameters;
+    NodeList list = collect(base);
+
+    return make<ParametersNode>(at(begin), list);
   }
   
-  ParametersNode *Parser::parseParameters() {
-    return static_cast<ParametersNode*>(parseList([this]() -> Node* {
-      return static_cast<Node*>(parseParameter());
-    }));
+  NodeId Parser::parseParameters() {
+    return parseList([this]() {
+      return parseParameter();
+    });
   }
   
-  ParametersNode *Parser::parseArguments() {
-    return static_cast<ParametersNode*>(parseList([this]() -> Node* {
-      return static_cast<Node*>(parseFormula());
-    }));
+  NodeId Parser::parseArguments() {
+    return parseList([this]() {
+      return parseFormula();
+    });
   }
 
-  void Parser::clearOperatorsStack(stack<Lexer::Token*> &ops, stack<Node*> &opds, function<bool()> expr) {
-    while (ops.size() != 0 && expr()) {
-      Node *second = opds.top();
-      opds.pop();
-      Node *first = opds.top();
-      opds.pop();
-
-      opds.push(new BinaryNode(*ops.top(), first, second, *ops.top()));
-      ops.pop();
-    }
-  }
-  
-  Node *Parser::parseParenthesisFormula() {
-    if(current->operatorType != Lexer::OperatorType::LeftParen)
-      return nullptr;
+  NodeId Parser::parseParenthesisFormula() {
+    if(peek().operatorType != Lexer::OperatorType::LeftParen)
+      return NodeId();
 
     auto begin = current;
     next();
 
-    Node *f = parseFormula();
+    NodeId f = parseFormula();
 
-    if(f == nullptr)
-      throw Error(*begin, "Expected formula");
+    if(!f)
+      throw Error(at(begin), "Expected formula");
 
-    try {
-      match(Lexer::OperatorType::RightParen);
+    match(Lexer::OperatorType::RightParen);
 
-      return f;
-    } catch (Error &e) {
-      delete f;
-
-      throw e;
-    }
+    return f;
   }
   
-  Node *Parser::parseFormula() {
-    stack<Node*> operands;
-    stack<Lexer::Token*> operators;
-    Node *operand = nullptr;
-
-    while (true) {
-      if((operand = parseOperand()) == nullptr) {
-        while(operands.size() != 0) {
-          delete operands.top();
-          operands.pop();
-        }
-          
-        return nullptr;
-      }
+  NodeId Parser::parseFormula() {
+    NodeId left = parseOperand();
 
-      operands.push(operand);
-      
-      if(OPERATION_PRIORITY.find(current->operatorType) != OPERATION_PRIORITY.end()) {
-        clearOperatorsStack(operators, operands, [this, operators]() -> bool {
-          return OPERATION_PRIORITY[current->operatorType] <= OPERATION_PRIORITY[operators.top()->operatorType];
-        });
+    return left ? parseBinary(left, 1) : NodeId();
+  }
 
-        operators.push(&*current);
-      } else {
-        clearOperatorsStack(operators, operands);
+  // Precedence climbing: folds every following operator that binds at
+  // least as tight as minPrecedence into left. The right operand takes the
+  // operators binding tighter than the current one, or as tight for
+  // right-associative ones.
+  NodeId Parser::parseBinary(NodeId left, uint8_t minPrecedence) {
+    while(true) {
+      BinaryOperator info = BINARY_OPERATORS[static_cast<size_t>(peek().operatorType)];
 
-        return operands.top();
-      }
+      if(info.precedence == 0 || info.precedence < minPrecedence)
+        return left;
 
+      Lexer::Token op = at(current);
       next();
+
+      NodeId right = parseOperand();
+
+      if(!right)
+        return NodeId();
+
+      right = parseBinary(right, info.rightAssociative ? info.precedence : info.precedence + 1);
+
+      if(!right)
+        return NodeId();
+
+      left = make<BinaryNode>(op, left, right);
     }
-    
-    return nullptr;
   }
   
-  UnaryNode *Parser::parseCall() {
-    if(KEYWORDS.find(current->value) != KEYWORDS.end())
-      return nullptr;
-    
-    auto begin = current;
-    ParametersNode *args = nullptr;
+  // A call is an identifier followed by '(', which one token of lookahead
+  // decides; anything else is left to the other operand rules
+  NodeId Parser::parseCall() {
+    if(peek().type != Lexer::Type::Identifier || isReserved(peek().keyword()))
+      return NodeId();
 
-    try {
-      Lexer::Token &id = match(Lexer::Type::Identifier);
-      args = parseArguments();
-      
-      return new UnaryNode(id, args, *begin);
-    } catch(Error &e) {
-      current = begin;
-      
-      return nullptr;
-    }
+    if(at(current + 1).operatorType != Lexer::OperatorType::LeftParen)
+      return NodeId();
+
+    Lexer::Token id = at(current);
+    next();
+
+    NodeId args = parseArguments();
+
+    return make<UnaryNode>(id, args);
   }
 
-  BinaryNode *Parser::parseIndex() {
-    if(current->operatorType != Lexer::OperatorType::LeftSquareParen)
-      return nullptr;
 
-    Lexer::Token &op = match(Lexer::OperatorType::LeftSquareParen);
-    Node *f = parseFormula();
+  NodeId Parser::parseIndex() {
+    if(peek().operatorType != Lexer::OperatorType::LeftSquareParen)
+      return NodeId();
 
-    try {
-      match(Lexer::OperatorType::RightSquareParen);
-    } catch(Error &e) {
-      delete f;
+    Lexer::Token op = match(Lexer::OperatorType::LeftSquareParen);
+    NodeId f = parseFormula();
 
-      throw e;
-    }
+    match(Lexer::OperatorType::RightSquareParen);
 
-    return new BinaryNode(op, nullptr, f, op);
+    return make<BinaryNode>(op, NodeId(), f);
   }
   
-  BinaryNode *Parser::parseIndexes(Node *left) {
-    BinaryNode *node = nullptr;
+  NodeId Parser::parseIndexes(NodeId left) {
+    NodeId node;
 
-    if((node = parseIndex()) != nullptr)
-      node->left = left;
+    if((node = parseIndex()))
+      tree.binary(node).left = left;
     else
-      return nullptr;
+      return NodeId();
       
-    while((node = parseIndex()) != nullptr) {
+    while((node = parseIndex())) {
     }
 
     return node;
   }
   
-  UnaryNode *Parser::parseUnaryOperator() {
-    if(current->operatorType != Lexer::OperatorType::Minus &&
-       current->operatorType != Lexer::OperatorType::BinAnd &&
-       current->operatorType != Lexer::OperatorType::At)
-      return nullptr;
-
-    Lexer::Token &op = match(Lexer::Type::Operator);
-    Node *opd = parseOperand();
+  NodeId Parser::parseUnaryOperator() {
+    if(peek().operatorType != Lexer::OperatorType::Minus &&
+       peek().operatorType != Lexer::OperatorType::BinAnd &&
+       peek().operatorType != Lexer::OperatorType::At)
+      return NodeId();
+
+    Lexer::Token op = match(Lexer::Type::Operator);
+    NodeId opd = parseOperand();
     
-    return new UnaryNode(op, opd, op);
+    return make<UnaryNode>(op, opd);
   }
   
-  Node *Parser::parseOperand() {
-    Node *operand = nullptr;
+  NodeId Parser::parseOperand() {
+    NodeId operand;
     auto begin = current;
     
-    if((operand = parseValue())              != nullptr ||
-       (operand = parseParenthesisFormula()) != nullptr ||
-       (operand = parseCall())               != nullptr ||
-       (operand = parseUnaryOperator())      != nullptr ||
-       (operand = parseVariable())           != nullptr) {
-      Node* opd = operand;
-      Node* additNode = nullptr; // additional node
-
-      if(current->value == "as") {
+    if((operand = parseValue())              ||
+       (operand = parseParenthesisFormula()) ||
+       (operand = parseCall())               ||
+       (operand = parseUnaryOperator())      ||
+       (operand = parseVariable())) {
+      NodeId opd = operand;
+      NodeId additNode; // additional node
+
+      if(peek().keyword() == Lexer::Keyword::As) {
         next();
-        pair<vector<Node*>, Lexer::Token&> t = parseType();
+        pair<NodeList, Lexer::Token> t = parseType();
         
-        opd->exprType = Type(t.second.value, t.first.size(), t.first.size() != 0);
+        tree.exprType(opd) = getType(t);
 
         return opd;
       }
 
-      if((additNode = parseIndex()) == nullptr)
+      if(!(additNode = parseIndex()))
         return operand;
 
-      static_cast<BinaryNode*>(additNode)->left = opd;
+      tree.binary(additNode).left = opd;
 
       return additNode;
     }
 
     current = begin;
-    return nullptr;
+    return NodeId();
   }
 
-  IfStatementNode *Parser::parseIfStatement() {
-    auto begin = current;
+  NodeId Parser::parseIfStatement() {
+    Lexer::Token first = peek();
     
-    if(current->value != "if")
-      return nullptr;
+    if(peek().keyword() != Lexer::Keyword::If)
+      return NodeId();
 
     next();
-    Node *cond = nullptr;
-    Node *ifstat = nullptr;
-    Node *elsestat = nullptr;
+    NodeId cond;
+    NodeId ifstat;
+    NodeId elsestat;
     
-    if((cond = parseParenthesisFormula()) == nullptr)
-      throw Error(*current, "Expected if-condition");
+    if(!(cond = parseParenthesisFormula()))
+      throw Error(at(current), "Expected if-condition");
 
-    try {
-      if((ifstat = parseStatements()) == nullptr &&
-         (ifstat = parseStatement())  == nullptr) {
-        delete cond;
-
-        throw Error(*current, "Expected statement or block of statements");
-      }
+    if(!(ifstat = parseStatements()) &&
+       !(ifstat = parseStatement()))
+      throw Error(at(current), "Expected statement or block of statements");
 
-      if(current->value != "else")
-        return new IfStatementNode(cond, ifstat, nullptr, *begin);
+    if(peek().keyword() != Lexer::Keyword::Else)
+      return make<IfStatementNode>(cond, ifstat, NodeId(), first);
 
-      next();
+    next();
     
-      if((elsestat = parseStatements()) == nullptr &&
-         (elsestat = parseStatement())  == nullptr) {
-        delete cond;
-        delete ifstat;
-
-        throw Error(*current, "Expected statement or block of statements");
-      }
-
-      return new IfStatementNode(cond, ifstat, elsestat, *begin);
-    } catch (Error &e) {
-      if(cond != nullptr)
-        delete cond;
+    if(!(elsestat = parseStatements()) &&
+       !(elsestat = parseStatement()))
+      throw Error(at(current), "Expected statement or block of statements");
 
-      if(ifstat != nullptr)
-        delete ifstat;
-
-      if(elsestat != nullptr)
-        delete elsestat;
-
-      throw e;
-    }
+    return make<IfStatementNode>(cond, ifstat, elsestat, first);
   }
 
-  CycleStatementNode *Parser::parseWhileStatement() {
-    auto begin = current;
+  NodeId Parser::parseWhileStatement() {
+    Lexer::Token first = peek();
     
-    if(current->value != "while")
-      return nullptr;
+    if(peek().keyword() != Lexer::Keyword::While)
+      return NodeId();
 
     next();
-    Node *cond = nullptr;
-    Node *stat = nullptr;
+    NodeId cond;
+    NodeId stat;
     
-    if((cond = parseParenthesisFormula()) == nullptr)
-      throw Error(*current, "Expected while-condition");
-
-    try {
-      if((stat = parseStatements()) == nullptr &&
-         (stat = parseStatement())  == nullptr) {
-        delete cond;
+    if(!(cond = parseParenthesisFormula()))
+      throw Error(at(current), "Expected while-condition");
 
-        throw Error(*current, "Expected statement or block of statements");
-      }
-
-      return new CycleStatementNode(cond, stat, *begin);
-    } catch (Error &e) {
-      if(cond != nullptr)
-        delete cond;
-
-      if(stat != nullptr)
-        delete stat;
+    if(!(stat = parseStatements()) &&
+       !(stat = parseStatement()))
+      throw Error(at(current), "Expected statement or block of statements");
 
-      throw e;
-    }
+    return make<CycleStatementNode>(cond, stat, first);
   }
 
-  CycleStatementNode *Parser::parseForStatement() {
-    auto begin = current;
+  NodeId Parser::parseForStatement() {
+    Lexer::Token first = peek();
     
-    if(current->value != "for")
-      return nullptr;
+    if(peek().keyword() != Lexer::Keyword::For)
+      return NodeId();
 
     next();
-    Node *cond = nullptr;
-    Node *stat = nullptr;
+    NodeId cond;
+    NodeId stat;
     
-    if((cond = parseArguments()) == nullptr)
-      throw Error(*current, "Expected for-condition");
+    if(!(cond = parseArguments()))
+      throw Error(at(current), "Expected for-condition");
 
-    try {
-      if((stat = parseStatements()) == nullptr &&
-         (stat = parseStatement())  == nullptr) {
-        delete cond;
+    if(!(stat = parseStatements()) &&
+       !(stat = parseStatement()))
+      throw Error(at(current), "Expected statement or block of statements");
 
-        throw Error(*current, "Expected statement or block of statements");
-      }
-
-      return new CycleStatementNode(cond, stat, *begin);
-    } catch (Error &e) {
-      if(cond != nullptr)
-        delete cond;
-
-      if(stat != nullptr)
-        delete stat;
-
-      throw e;
-    }
+    return make<CycleStatementNode>(cond, stat, first);
   }
 }
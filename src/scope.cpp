@@ -1,50 +1,45 @@
 #include "scope.hpp"
 #include "arch.hpp"
 #include "AST.hpp"
+#include <utility>
 
 using namespace AST;
 
-Function::Function(FunctionNode *node_)
-  : node(node_), variablesOffset(0) {}
+Function::Function(Tree &tree_, FunctionNode *node_)
+  : tree(&tree_), node(node_), variablesOffset(0), printedBlocks(1) {}
 
-Variable &Scope::addVariable(AST::VariableNode *node_, AssemblerType asmtype) {
-  return variables.insert({ node_->name.value, Variable(node_, 0, asmtype) }).first->second;
+Variable &Scope::addVariable(std::string_view name, const AST::Tree &tree, AST::VariableNode *node_,
+                             const AssemblerType &asmtype) {
+  return variables.try_emplace(name, tree, node_, 0, asmtype).first->second;
 }
 
-Variable &Function::addVariable(AST::VariableNode *node_, AssemblerType asmtype) {
-  if(node_->modifiers.size() != 0 && node_->modifiers[0]->type == NodeType::BinaryOperator) {
-    auto sa = Variable(node_, variablesOffset, asmtype);
-    variables.insert({node_->name.value, sa});
-
+Variable &Function::addVariable(std::string_view name, const AST::Tree &tree_, AST::VariableNode *node_,
+                                const AssemblerType &asmtype) {
+  if(node_->modifiers.size() != 0 && node_->modifiers[0].type() == NodeType::BinaryOperator) {
+    // Made first, so a redeclaration is checked and takes room like the
+    // first declaration did
+    Variable sa(tree_, node_, variablesOffset, asmtype);
+    sa.isLocal = true;
     variablesOffset += sa.arraySizeInBytes;
 
-    return variables.insert({ node_->name.value, sa }).first->second;
+    return variables.try_emplace(name, std::move(sa)).first->second;
   }
 
-  if(node_->exprType.isPointer)
-    asmtype = NAT_ASMTYPE;
-
-  Variable &var = variables.insert({ node_->name.value, Variable(node_, variablesOffset, asmtype) }).first->second;
-  variablesOffset += asmtype.size;
+  const AssemblerType &type = node_->exprType.isPointer ? NAT_ASMTYPE : asmtype;
+  Variable &var = variables.try_emplace(name, tree_, node_, variablesOffset, type).first->second;
+  var.isLocal = true;
+  variablesOffset += type.size;
 
   return var;
 }
 
-Variable &GlobalScope::addVariable(AST::VariableNode *node_, AssemblerType asmtype) {
-  if(node_->modifiers.size() != 0 && node_->modifiers[0]->type == NodeType::BinaryOperator) {
-    auto sa = Variable(node_, 0, asmtype);
-    variables.insert({ node_->name.value, sa });
+Variable &GlobalScope::addVariable(std::string_view name, const AST::Tree &tree, AST::VariableNode *node_,
+                                   const AssemblerType &asmtype) {
+  if(node_->modifiers.size() != 0 && node_->modifiers[0].type() == NodeType::BinaryOperator) {
+    Variable sa(tree, node_, 0, asmtype);
 
-    return variables.insert({ node_->name.value, sa }).first->second;
+    return variables.try_emplace(name, std::move(sa)).first->second;
   }
 
-  if(node_->exprType.isPointer)
-    asmtype = NAT_ASMTYPE;
-
-  if(node_->modifiers.size() != 0 && node_->modifiers[0]->type == NodeType::BinaryOperator)
-    variables.insert({ node_->name.value, Variable(node_, 0, asmtype)});
-
-  Variable var = Variable(node_, 0, asmtype);
-
-  return variables.insert({ node_->name.value, var }).first->second;
+  return variables.try_emplace(name, tree, node_, 0, node_->exprType.isPointer ? NAT_ASMTYPE : asmtype).first->second;
 }
@@ -0,0 +1,432 @@
+#include "semantic.hpp"
+#include "parser.hpp"
+#include "arch.hpp"
+#include <string>
+
+using namespace AST;
+using namespace Parser;
+
+namespace Semantic {
+  // Operators whose right operand is taken as an immediate or a symbol
+  // when it is a constant, which is then never compiled as a formula
+  static bool takesConstantOperand(Lexer::OperatorType op) {
+    switch(op) {
+    case Lexer::OperatorType::Plus:
+    case Lexer::OperatorType::Minus:
+    case Lexer::OperatorType::And:
+    case Lexer::OperatorType::Or:
+    case Lexer::OperatorType::BinAnd:
+    case Lexer::OperatorType::BinOr:
+    case Lexer::OperatorType::More:
+    case Lexer::OperatorType::Less:
+    case Lexer::OperatorType::Equals:
+    case Lexer::OperatorType::NotEquals:
+    case Lexer::OperatorType::MoreOrEquals:
+    case Lexer::OperatorType::LessOrEquals:
+      return true;
+
+    default:
+      return false;
+    }
+  }
+
+  static bool isBinaryOperator(Lexer::OperatorType op) {
+    switch(op) {
+    case Lexer::OperatorType::Multiply:
+    case Lexer::OperatorType::Divide:
+    case Lexer::OperatorType::Percent:
+    case Lexer::OperatorType::Pow:
+      return true;
+
+    default:
+      return takesConstantOperand(op);
+    }
+  }
+
+  Analyzer::Analyzer(std::string_view source_, GlobalScope &global_, Function &func_, bool inlineAssembly_)
+    : source(source_), global(global_), func(func_), tree(*func_.tree), inlineAssembly(inlineAssembly_) {}
+
+  std::string_view Analyzer::value(const Lexer::Token &tok) {
+    return tok.value(source);
+  }
+
+  // A name is bound to the local of that name declared so far, or else
+  // to the global
+  Variable &Analyzer::bindVariable(ValueNode &val) {
+    if(val.variable == nullptr) {
+      auto local = func.variables.find(value(val.value));
+
+      if(local != func.variables.end()) {
+        val.variable = &local->second;
+      } else {
+        auto var = global.variables.find(value(val.value));
+
+        if(var != global.variables.end())
+          val.variable = &var->second;
+      }
+    }
+
+    if(val.variable == nullptr)
+      throw Error(val.value, "Undefined variable '" + std::string(value(val.value)) + "'");
+
+    return *val.variable;
+  }
+
+  Type Analyzer::valueType(ValueNode &val) {
+    switch (val.value.type) {
+    case Lexer::Type::String:
+      return Type(TypeId::Byte, 1, false);
+
+    case Lexer::Type::Integer:
+    case Lexer::Type::Char:
+      return Type(TypeId::CtInt, 0, false);
+
+    case Lexer::Type::Identifier:
+      return bindVariable(val).node->exprType;
+
+    default:
+      throw Error(val.value, "Not implemented #4");
+    }
+  }
+
+  bool Analyzer::compareOperandsTypes(const Type &first, const Type &second) {
+    if(first.base == TypeId::CtInt || second.base == TypeId::CtInt)
+      return true;
+
+    return asmType(first).width == asmType(second).width;
+  }
+
+  void Analyzer::analyze() {
+    if(func.node->body.type() == NodeType::Statements)
+      analyzeStatements(func.node->body);
+    else
+      analyzeFormula(func.node->body);
+  }
+
+  void Analyzer::analyzeStatements(NodeId stmts) {
+    for(auto stmt : tree.statements(stmts).statements)
+      analyzeStatement(stmt);
+  }
+
+  void Analyzer::analyzeBody(NodeId body) {
+    if(body.type() == NodeType::Statements)
+      analyzeStatements(body);
+    else
+      analyzeStatement(body);
+  }
+
+  void Analyzer::analyzeStatement(NodeId stmt) {
+    switch (stmt.type()) {
+    case NodeType::UnaryOperator:
+      if(value(tree.unary(stmt).op) == "asm")
+        analyzeAsmIncluding(tree.unary(stmt).node);
+      else
+        analyzeFormula(stmt);
+
+      break;
+    case NodeType::BinaryOperator:
+    case NodeType::Value:
+      analyzeFormula(stmt);
+      break;
+    case NodeType::Variable:
+      analyzeVariableDeclaration(tree.variable(stmt));
+      break;
+    case NodeType::IfStatement:
+      analyzeIfStatement(stmt);
+      break;
+    case NodeType::WhileStatement:
+      analyzeCycleStatement(stmt);
+      break;
+    default:
+      throw Error(tree.begin(stmt), "Not implemented #3");
+    }
+  }
+
+  void Analyzer::analyzeVariableDeclaration(VariableNode &varNode) {
+    if(varNode.exprType.base == TypeId::Unknown)
+      throw Error(varNode.varTypeToken, "Unknown variable type");
+
+    Variable &var = func.addVariable(value(varNode.name), tree, &varNode, asmType(varNode.exprType.base));
+    varNode.variable = &var;
+
+    if(var.variableType == VariableType::StaticArray && var.node->body) {
+      if(varNode.body)
+        throw Error(tree.begin(varNode.body), "Can't initialize array [Not implemented]");
+    } else if(varNode.body) {
+      analyzeFormula(varNode.body);
+    }
+  }
+
+  void Analyzer::analyzeAsmIncluding(NodeId strings) {
+    for(auto i : tree.parameters(strings).parameters) {
+      if(i.type() != NodeType::Value || tree.value(i).value.type != Lexer::Type::String)
+        throw Error(tree.begin(i), "Expected string literal");
+
+      if(!inlineAssembly)
+        throw Error(tree.begin(i), "Inline assembly can't be compiled to machine code");
+    }
+  }
+
+  void Analyzer::analyzeIfStatement(NodeId ifstat) {
+    const IfStatementNode &node = tree.ifStatement(ifstat);
+
+    analyzeFormula(node.condition);
+    analyzeBody(node.ifstatement);
+
+    if(node.elsestatement)
+      analyzeBody(node.elsestatement);
+  }
+
+  // The step of a for is compiled after its body
+  void Analyzer::analyzeCycleStatement(NodeId cycle) {
+    const CycleStatementNode &node = tree.cycleStatement(cycle);
+
+    if(node.condition.type() == NodeType::Parameters) {
+      NodeList args = tree.parameters(node.condition).parameters;
+
+      analyzeFormula(args[0]);
+      analyzeFormula(args[1]);
+      analyzeBody(node.statement);
+      analyzeFormula(args[2]);
+    } else {
+      analyzeFormula(node.condition);
+      analyzeBody(node.statement);
+    }
+  }
+
+  void Analyzer::analyzeFormula(NodeId node) {
+    switch (node.type()) {
+    case NodeType::BinaryOperator:
+      analyzeBinary(tree.binary(node));
+      break;
+
+    case NodeType::UnaryOperator:
+      analyzeUnary(tree.unary(node));
+      break;
+
+    case NodeType::Value:
+      analyzeValue(tree.value(node));
+      break;
+
+    default:
+      throw Error(tree.begin(node), "Not implemented #5");
+    }
+  }
+
+  // A type given with 'as' is kept
+  void Analyzer::analyzeValue(ValueNode &val) {
+    if(val.exprType.isNull())
+      val.exprType = valueType(val);
+
+    switch(val.value.type) {
+    case Lexer::Type::Integer:
+    case Lexer::Type::Char:
+    case Lexer::Type::String:
+      break;
+
+    case Lexer::Type::Identifier:
+      bindVariable(val);
+      break;
+
+    default:
+      throw Error(val.value, "Not implemented #1");
+    }
+  }
+
+  void Analyzer::analyzeVariableAddress(ValueNode &varNode) {
+    Variable &var = bindVariable(varNode);
+
+    if(varNode.exprType.isNull())
+      varNode.exprType = var.node->exprType;
+  }
+
+  void Analyzer::analyzeBinary(BinaryNode &bin) {
+    switch(bin.op.operatorType) {
+    case Lexer::OperatorType::Assign:
+      analyzeAssign(bin);
+      return;
+    case Lexer::OperatorType::LeftSquareParen:
+      analyzeIndex(bin);
+      return;
+    default:
+      break;
+    }
+
+    analyzeFormula(bin.left);
+
+    if(takesConstantOperand(bin.op.operatorType) && bin.right.type() == NodeType::Value && !tree.isVariable(bin.right)) {
+      ValueNode &right = tree.value(bin.right);
+
+      if(right.exprType.isNull())
+        right.exprType = valueType(right);
+    } else {
+      analyzeFormula(bin.right);
+    }
+
+    const Type &left = tree.exprType(bin.left), &right = tree.exprType(bin.right);
+
+    if(!compareOperandsTypes(left, right))
+      throw Error(bin.op.offset, "Incompatible types of operands");
+
+    if(!isBinaryOperator(bin.op.operatorType))
+      throw Error(bin.op.offset, "Unknown binary operator");
+
+    if(bin.exprType.isNull())
+      bin.exprType = left.base == TypeId::CtInt ? right : left;
+  }
+
+  // The type of an element of the left operand
+  void Analyzer::analyzeIndex(BinaryNode &bin) {
+    analyzeFormula(bin.left);
+    analyzeFormula(bin.right);
+
+    bin.exprType = tree.exprType(bin.left);
+
+    if(bin.exprType.pointerLevel == 0)
+      throw Error(bin.op.offset, "The indexing operation requires a pointer");
+
+    --bin.exprType.pointerLevel;
+  }
+
+  // An assignment has the type of its left operand, whatever 'as' says
+  void Analyzer::analyzeAssign(BinaryNode &bin) {
+    analyzeAssignLeftOperand(bin.left);
+    analyzeFormula(bin.right);
+
+    if(!compareOperandsTypes(tree.exprType(bin.left), tree.exprType(bin.right)))
+      throw Error(bin.op.offset, "Incompatible types of operands 1");
+
+    bin.exprType = tree.exprType(bin.left);
+  }
+
+  // The left operand is compiled to an address, and typed as what it
+  // points at
+  void Analyzer::analyzeAssignLeftOperand(NodeId opd) {
+    switch (opd.type()) {
+    case NodeType::BinaryOperator: {
+      BinaryNode &bin = tree.binary(opd);
+
+      if(bin.op.operatorType == Lexer::OperatorType::LeftSquareParen)
+        analyzeIndex(bin);
+      else
+        analyzeBinary(bin);
+
+      break;
+    }
+
+    case NodeType::UnaryOperator: {
+      UnaryNode &unr = tree.unary(opd);
+
+      if(unr.op.operatorType == Lexer::OperatorType::At && tree.isVariable(unr.node)) {
+        ValueNode &varNode = tree.value(unr.node);
+
+        analyzeVariableAddress(varNode);
+        unr.exprType = valueType(varNode);
+        --unr.exprType.pointerLevel;
+        break;
+      }
+
+      analyzeFormula(unr.node);
+
+      if(unr.exprType.isNull()) {
+        unr.exprType = tree.exprType(unr.node);
+        --unr.exprType.pointerLevel;
+      }
+
+      break;
+    }
+
+    case NodeType::Value:
+      if(tree.isVariable(opd))
+        analyzeVariableAddress(tree.value(opd));
+      else
+        analyzeValue(tree.value(opd));
+
+      break;
+
+    default:
+      throw Error(tree.begin(opd), "Not implemented #2");
+    }
+  }
+
+  void Analyzer::analyzeUnary(UnaryNode &unr) {
+    if(unr.node.type() == NodeType::Parameters) {
+      analyzeCall(unr);
+      return;
+    }
+
+    Type presetType = unr.exprType;
+
+    switch (unr.op.operatorType) {
+    case Lexer::OperatorType::HardArrowRight:
+      analyzeFormula(unr.node);
+      break;
+
+    // Typed from the operand as it was before the operand is typed
+    case Lexer::OperatorType::BinAnd:
+      if(!tree.isVariable(unr.node))
+        throw Error(unr.op, "Can't take adress of expression");
+
+      unr.exprType = tree.exprType(unr.node);
+      analyzeVariableAddress(tree.value(unr.node));
+      unr.exprType.isPointer = true;
+      ++unr.exprType.pointerLevel;
+
+      if(!presetType.isNull())
+        unr.exprType = presetType;
+
+      break;
+
+    case Lexer::OperatorType::At:
+      analyzeFormula(unr.node);
+
+      unr.exprType = tree.exprType(unr.node);
+
+      if(unr.exprType.pointerLevel == 0)
+        throw Error(unr.op, "Indirection requires pointer operand");
+
+      --unr.exprType.pointerLevel;
+
+      if(!presetType.isNull())
+        unr.exprType = presetType;
+
+      break;
+
+    default:
+      throw Error(unr.op, "Unknown unary operator");
+    }
+  }
+
+  // Constant arguments are pushed as they are and never typed. The callee
+  // may be in another tree, when it was declared before a reset.
+  void Analyzer::analyzeCall(UnaryNode &fnNode) {
+    NodeList args = tree.parameters(fnNode.node).parameters;
+    auto callee = global.functions.find(value(fnNode.op));
+
+    if(callee == global.functions.end())
+      throw Error(fnNode.op, "Undefined function");
+
+    const Tree &calleeTree = *callee->second.tree;
+    FunctionNode *calleeNode = callee->second.node;
+    NodeList params = calleeTree.parameters(calleeNode->parameters).parameters;
+
+    if(params.size() != args.size())
+      throw Error(fnNode.op, "Not enough arguments");
+
+    if(fnNode.exprType.isNull())
+      fnNode.exprType = calleeNode->exprType;
+
+    for(size_t i = 0; i < args.size(); ++i) {
+      NodeId arg = args[i];
+
+      if(arg.type() == NodeType::Value && !tree.isVariable(arg) &&
+         tree.value(arg).value.type != Lexer::Type::String)
+        continue;
+
+      analyzeFormula(arg);
+
+      if(calleeTree.variable(params[i]).exprType != tree.exprType(arg))
+        throw Error(tree.begin(arg), "Unexpected argument type");
+    }
+  }
+}
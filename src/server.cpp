@@ -0,0 +1,295 @@
+#include "server.hpp"
+#include "driver.hpp"
+#include "thread_pool.hpp"
+#include "cache.hpp"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A request is one byte that carries the client's stdout and stderr, then
+// the number of strings and the strings, each after its length: the
+// working directory of the client and its command line. The reply is the
+// exit status.
+namespace Server {
+  // Bounds a request, so a broken one can't make the server allocate
+  // without end
+  static constexpr uint32_t MAX_STRINGS = 1 << 20;
+  static constexpr uint32_t MAX_STRING_SIZE = 1 << 20;
+
+  static bool writeAll(int fd, const void *data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+
+    while(size > 0) {
+      ssize_t written = write(fd, bytes, size);
+
+      if(written < 0 && errno == EINTR)
+        continue;
+
+      if(written <= 0)
+        return false;
+
+      bytes += written;
+      size -= static_cast<size_t>(written);
+    }
+
+    return true;
+  }
+
+  static bool readAll(int fd, void *data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+
+    while(size > 0) {
+      ssize_t got = read(fd, bytes, size);
+
+      if(got < 0 && errno == EINTR)
+        continue;
+
+      if(got <= 0)
+        return false;
+
+      bytes += got;
+      size -= static_cast<size_t>(got);
+    }
+
+    return true;
+  }
+
+  static bool socketAddress(const std::string &path, sockaddr_un &address) {
+    if(path.size() >= sizeof(address.sun_path))
+      return false;
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+  }
+
+  static bool readRequest(int connection, int (&fds)[2], std::vector<std::string> &strings) {
+    char byte;
+    iovec data = { &byte, 1 };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    msghdr message{};
+
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if(recvmsg(connection, &message, MSG_CMSG_CLOEXEC) != 1)
+      return false;
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+
+    if(!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+       header->cmsg_len != CMSG_LEN(sizeof(fds)))
+      return false;
+
+    std::memcpy(fds, CMSG_DATA(header), sizeof(fds));
+
+    uint32_t count;
+
+    if(!readAll(connection, &count, sizeof(count)) || count < 2 || count > MAX_STRINGS)
+      return false;
+
+    for(uint32_t i = 0; i < count; ++i) {
+      uint32_t size;
+
+      if(!readAll(connection, &size, sizeof(size)) || size > MAX_STRING_SIZE)
+        return false;
+
+      strings.emplace_back(size, '\0');
+
+      if(!readAll(connection, strings.back().data(), size))
+        return false;
+    }
+
+    return true;
+  }
+
+  // Whether the client runs as the same user as the server, which is the
+  // only one it compiles for
+  static bool fromOwner(int connection) {
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+
+    return getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+      credentials.uid == geteuid();
+  }
+
+  // The server's own cache is used whatever the request asks for
+  static void serveConnection(int connection, ThreadPool &pool, Cache::Cache &cache) {
+    int fds[2] = { -1, -1 };
+    std::vector<std::string> strings;
+
+    if(!fromOwner(connection))
+      return;
+
+    if(!readRequest(connection, fds, strings)) {
+      for(int fd : fds)
+        if(fd >= 0)
+          close(fd);
+
+      return;
+    }
+
+    std::ostringstream diagnostics;
+    std::vector<std::string> args(strings.begin() + 1, strings.end());
+    Driver::Command command;
+    int32_t status = 1;
+
+    try {
+      if(Driver::parseCommand(args, strings[0], command, diagnostics)) {
+        if(!command.server.empty() || command.run) {
+          diagnostics << "--server and --run can't be sent to a server" << std::endl;
+        } else {
+          command.options.cache = &cache;
+          status = Driver::execute(command, pool, fds[0], diagnostics);
+        }
+      }
+    } catch(std::exception &e) {
+      diagnostics << e.what() << std::endl;
+    }
+
+    std::string text = diagnostics.str();
+
+    writeAll(fds[1], text.data(), text.size());
+    close(fds[0]);
+    close(fds[1]);
+    writeAll(connection, &status, sizeof(status));
+  }
+
+  int serve(const std::string &socketPath, ThreadPool &pool, Cache::Cache &cache) {
+    sockaddr_un address;
+    struct stat st;
+
+    if(!socketAddress(socketPath, address)) {
+      std::cerr << "The socket path '" << socketPath << "' is too long" << std::endl;
+      return 1;
+    }
+
+    // A socket left behind by a server that was killed refuses connections
+    // and is replaced. Any other belongs to a server still running.
+    if(lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+      int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      bool stale = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 &&
+        errno == ECONNREFUSED;
+
+      if(probe >= 0)
+        close(probe);
+
+      if(!stale) {
+        std::cerr << "A server is already serving on '" << socketPath << '\'' << std::endl;
+        return 1;
+      }
+
+      unlink(socketPath.c_str());
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool bound = false;
+
+    // The socket is made accessible to its owner only
+    if(listener >= 0) {
+      mode_t mask = umask(077);
+      bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+      umask(mask);
+    }
+
+    if(!bound || listen(listener, SOMAXCONN) != 0) {
+      std::cerr << "Can't listen on '" << socketPath << "': " << std::strerror(errno) << std::endl;
+      return 1;
+    }
+
+    // A client that goes away must not take the server with it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    for(;;) {
+      int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+
+      if(connection < 0) {
+        if(errno == EINTR || errno == ECONNABORTED)
+          continue;
+
+        std::cerr << "Can't accept a connection: " << std::strerror(errno) << std::endl;
+        return 1;
+      }
+
+      pool.push([connection, &pool, &cache]() {
+        serveConnection(connection, pool, cache);
+        close(connection);
+      });
+    }
+  }
+
+  int request(const std::string &socketPath, const std::vector<std::string> &args) {
+    sockaddr_un address;
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    char directory[PATH_MAX];
+
+    if(!socketAddress(socketPath, address) || connection < 0 ||
+       connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+      std::cerr << "Can't connect to '" << socketPath << '\'' << std::endl;
+      return 1;
+    }
+
+    if(!getcwd(directory, sizeof(directory))) {
+      std::cerr << "Can't get the working directory" << std::endl;
+      return 1;
+    }
+
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char byte = 0;
+    iovec data = { &byte, 1 };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr message{};
+
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    std::string request;
+    auto put = [&request](uint32_t number) {
+      request.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    };
+
+    put(static_cast<uint32_t>(args.size() + 1));
+    put(static_cast<uint32_t>(std::strlen(directory)));
+    request += directory;
+
+    for(auto &arg : args) {
+      put(static_cast<uint32_t>(arg.size()));
+      request += arg;
+    }
+
+    int32_t status;
+
+    // A server that drops the connection, as it does for another user, is
+    // reported rather than killing the client
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if(sendmsg(connection, &message, 0) != 1 || !writeAll(connection, request.data(), request.size()) ||
+       !readAll(connection, &status, sizeof(status))) {
+      std::cerr << "The server at '" << socketPath << "' didn't answer" << std::endl;
+      close(connection);
+      return 1;
+    }
+
+    close(connection);
+    return status;
+  }
+}
@@ -0,0 +1,192 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <iterator>
+
+// The pool and queue the current thread works for, if it is a worker
+static thread_local const ThreadPool *workerPool = nullptr;
+static thread_local size_t workerQueue = 0;
+
+ThreadPool::ThreadPool(size_t threads) : queued(0), stopping(false) {
+  for(size_t i = 0; i < (threads > 0 ? threads : 1); ++i)
+    queues.push_back(std::make_unique<Queue>());
+
+  for(size_t i = 1; i < threads; ++i)
+    workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+
+  available.notify_all();
+
+  for(auto &i : workers)
+    i.join();
+}
+
+size_t ThreadPool::size() const {
+  return workers.size() + 1;
+}
+
+size_t ThreadPool::ownQueue() const {
+  return workerPool == this ? workerQueue : 0;
+}
+
+// The own queue is used as a stack, which keeps nested tasks close to
+// their parent; others are robbed from the other end, where the oldest
+// and usually largest tasks are. With a group, only its tasks are taken.
+bool ThreadPool::take(size_t own, const TaskGroup *group, Task &task) {
+  for(size_t i = 0; i < queues.size(); ++i) {
+    Queue &queue = *queues[(own + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    auto &tasks = queue.tasks;
+
+    if(tasks.empty())
+      continue;
+
+    auto matches = [group](const Task &queuedTask) { return !group || queuedTask.group == group; };
+    auto found = tasks.end();
+
+    if(i == 0 && own != 0) {
+      auto last = std::find_if(tasks.rbegin(), tasks.rend(), matches);
+
+      if(last != tasks.rend())
+        found = std::prev(last.base());
+    } else {
+      found = std::find_if(tasks.begin(), tasks.end(), matches);
+    }
+
+    if(found == tasks.end())
+      continue;
+
+    task = std::move(*found);
+    tasks.erase(found);
+    --queued;
+
+    if(task.group)
+      --task.group->queued;
+
+    return true;
+  }
+
+  return false;
+}
+
+void ThreadPool::work(size_t index) {
+  workerPool = this;
+  workerQueue = index;
+
+  while(true) {
+    Task task;
+
+    if(take(index, nullptr, task)) {
+      run(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    available.wait(lock, [this]() { return stopping || queued.load() != 0; });
+
+    if(stopping && queued.load() == 0)
+      return;
+  }
+}
+
+// A task is charged to what pushed it, whichever thread runs it
+void ThreadPool::run(Task &task) {
+  TimeReport::Charge charge(task.usage);
+
+  task.run();
+}
+
+void ThreadPool::push(std::function<void()> task) {
+  push(std::move(task), nullptr);
+}
+
+void ThreadPool::push(std::function<void()> task, TaskGroup *group) {
+  // Counted before it is queued, so a thread taking it never sees the
+  // counter go below zero
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    ++queued;
+  }
+
+  {
+    Queue &queue = *queues[ownQueue()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back({ std::move(task), group, TimeReport::chargedUsage() });
+  }
+
+  available.notify_one();
+}
+
+bool ThreadPool::runPending(const TaskGroup &group) {
+  Task task;
+
+  if(!take(ownQueue(), &group, task))
+    return false;
+
+  run(task);
+
+  return true;
+}
+
+TaskGroup::TaskGroup(ThreadPool &pool_) : pool(pool_), pending(0), queued(0) {}
+
+TaskGroup::~TaskGroup() {
+  waitTasks();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++pending;
+    ++queued;
+  }
+
+  changed.notify_all();
+
+  pool.push([this, task = std::move(task)]() {
+    try {
+      task();
+    } catch(...) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if(!error)
+        error = std::current_exception();
+    }
+
+    finishTask();
+  }, this);
+}
+
+// The group may be destroyed as soon as the waiter sees the count at zero,
+// which it only looks at under the lock
+void TaskGroup::finishTask() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if(--pending == 0)
+    changed.notify_all();
+}
+
+void TaskGroup::waitTasks() {
+  while(true) {
+    if(pool.runPending(*this))
+      continue;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return pending.load() == 0 || queued.load() != 0; });
+
+    if(pending.load() == 0)
+      return;
+  }
+}
+
+void TaskGroup::wait() {
+  waitTasks();
+
+  if(error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,198 @@
+#include "time_report.hpp"
+#include <cstdio>
+#include <ctime>
+#include <sys/resource.h>
+
+namespace TimeReport {
+  static thread_local Usage *charged = nullptr;
+
+  static std::chrono::nanoseconds threadCpuTime() {
+    timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+  }
+
+  static size_t peakRss() {
+    rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+  }
+
+  static double seconds(std::chrono::nanoseconds time) {
+    return std::chrono::duration<double>(time).count();
+  }
+
+  static double perSecond(double count, std::chrono::nanoseconds time) {
+    return time.count() > 0 ? count / seconds(time) : 0;
+  }
+
+  static void printJsonString(std::ostream &out, const std::string &text) {
+    out << '"';
+
+    for(char ch : text) {
+      if(ch == '"' || ch == '\\') {
+        out << '\\' << ch;
+      } else if(static_cast<unsigned char>(ch) < 0x20) {
+        char escape[7];
+
+        std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(ch));
+        out << escape;
+      } else {
+        out << ch;
+      }
+    }
+
+    out << '"';
+  }
+
+  Usage *chargedUsage() {
+    return charged;
+  }
+
+  Charge::Charge(Usage *usage_) : usage(usage_), previous(charged) {
+    charged = usage;
+
+    if(usage && usage != previous) {
+      cpuStart = threadCpuTime();
+      allocationsStart = Allocations::current();
+    }
+  }
+
+  Charge::~Charge() {
+    if(usage && usage != previous) {
+      Allocations::Counts used = Allocations::current() - allocationsStart;
+
+      usage->cpu.fetch_add((threadCpuTime() - cpuStart).count(), std::memory_order_relaxed);
+      usage->allocations.fetch_add(used.allocations, std::memory_order_relaxed);
+      usage->allocatedBytes.fetch_add(used.bytes, std::memory_order_relaxed);
+    }
+
+    charged = previous;
+  }
+
+  Report::Report() : previous(charged) {
+    charged = &usage;
+    phases.reserve(8);
+    start();
+  }
+
+  Report::~Report() {
+    charged = previous;
+  }
+
+  // A task is counted once it is done, so one still running when a phase
+  // ends counts toward the next
+  std::chrono::nanoseconds Report::cpuTime() const {
+    return threadCpuTime() + std::chrono::nanoseconds(usage.cpu.load(std::memory_order_relaxed));
+  }
+
+  Allocations::Counts Report::allocations() const {
+    Allocations::Counts own = Allocations::current();
+
+    return { own.allocations + usage.allocations.load(std::memory_order_relaxed),
+             own.bytes + usage.allocatedBytes.load(std::memory_order_relaxed) };
+  }
+
+  void Report::start() {
+    allocationsStart = allocations();
+    cpuStart = cpuTime();
+    wallStart = std::chrono::steady_clock::now();
+  }
+
+  void Report::endPhase(std::string name) {
+    auto wall = std::chrono::steady_clock::now() - wallStart;
+    auto cpu = cpuTime() - cpuStart;
+    Allocations::Counts used = allocations() - allocationsStart;
+
+    phases.push_back({ std::move(name), wall, cpu, used });
+    start();
+  }
+
+  void Report::print(std::ostream &out, const std::string &fileName, bool json) const {
+    Phase total{ "total", {}, {}, {} };
+    std::chrono::nanoseconds parse{0};
+
+    for(auto &phase : phases) {
+      total.wall += phase.wall;
+      total.cpu += phase.cpu;
+      total.allocations.allocations += phase.allocations.allocations;
+      total.allocations.bytes += phase.allocations.bytes;
+
+      if(phase.name.compare(0, 5, "parse") == 0)
+        parse = phase.wall;
+    }
+
+    double tokensPerSecond = perSecond(static_cast<double>(tokens), parse);
+    double nodesPerSecond = perSecond(static_cast<double>(nodes), parse);
+    double megabytesPerSecond = perSecond(static_cast<double>(sourceBytes) / 1e6, total.wall);
+
+    if(json) {
+      out << "{\"file\":";
+      printJsonString(out, fileName);
+      out << ",\"phases\":[";
+
+      for(size_t i = 0; i < phases.size(); ++i) {
+        out << (i ? "," : "") << "{\"name\":";
+        printJsonString(out, phases[i].name);
+        out << ",\"wall\":" << seconds(phases[i].wall) << ",\"cpu\":" << seconds(phases[i].cpu)
+            << ",\"allocations\":" << phases[i].allocations.allocations
+            << ",\"allocatedBytes\":" << phases[i].allocations.bytes << '}';
+      }
+
+      out << "],\"wall\":" << seconds(total.wall) << ",\"cpu\":" << seconds(total.cpu)
+          << ",\"allocations\":" << total.allocations.allocations
+          << ",\"allocatedBytes\":" << total.allocations.bytes
+          << ",\"semanticAnalysis\":" << seconds(analysis)
+          << ",\"sourceBytes\":" << sourceBytes << ",\"tokens\":" << tokens << ",\"nodes\":" << nodes
+          << ",\"functions\":" << functions << ",\"outputBytes\":" << outputBytes
+          << ",\"tokensPerSecond\":" << tokensPerSecond << ",\"nodesPerSecond\":" << nodesPerSecond
+          << ",\"megabytesPerSecond\":" << megabytesPerSecond << '}' << std::endl;
+      return;
+    }
+
+    char line[128];
+
+    out << "Time report for " << fileName << '\n';
+    std::snprintf(line, sizeof(line), "  %-18s %10s %10s %12s %14s\n", "phase", "wall (s)", "cpu (s)",
+                  "allocations", "bytes");
+    out << line;
+
+    auto printPhase = [&](const Phase &phase) {
+      std::snprintf(line, sizeof(line), "  %-18s %10.6f %10.6f %12llu %14llu\n", phase.name.c_str(),
+                    seconds(phase.wall), seconds(phase.cpu),
+                    static_cast<unsigned long long>(phase.allocations.allocations),
+                    static_cast<unsigned long long>(phase.allocations.bytes));
+      out << line;
+    };
+
+    for(auto &phase : phases)
+      printPhase(phase);
+
+    printPhase(total);
+    std::snprintf(line, sizeof(line), "  %-18s %10.6f (summed over the threads)\n", "semantic analysis",
+                  seconds(analysis));
+    out << line;
+    std::snprintf(line, sizeof(line), "  source: %zu bytes, %.1f MB/s\n", sourceBytes, megabytesPerSecond);
+    out << line;
+    std::snprintf(line, sizeof(line), "  tokens: %zu, %.0f/s while parsing\n", tokens, tokensPerSecond);
+    out << line;
+    std::snprintf(line, sizeof(line), "  nodes: %zu, %.0f/s while parsing\n", nodes, nodesPerSecond);
+    out << line;
+    std::snprintf(line, sizeof(line), "  functions: %zu, output: %zu bytes\n", functions, outputBytes);
+    out << line << std::flush;
+  }
+
+  void printPeakRss(std::ostream &out, bool json) {
+    if(json) {
+      out << "{\"peakRss\":" << peakRss() << '}' << std::endl;
+      return;
+    }
+
+    char line[64];
+
+    std::snprintf(line, sizeof(line), "Peak RSS: %.1f MB\n", static_cast<double>(peakRss()) / 1e6);
+    out << line << std::flush;
+  }
+}
@@ -0,0 +1,47 @@
+#include "token_stream.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Lexer {
+  TokenStream::TokenStream(Lexer &lexer_)
+    : lexer(lexer_), ring(256, Token(Type::EndOfFile, 0)), first(0), last(0), ended(false) {}
+
+  void TokenStream::grow() {
+    std::vector<Token> bigger(ring.size() * 2, Token(Type::EndOfFile, 0));
+
+    for(size_t i = first; i < last; ++i)
+      bigger[i & (bigger.size() - 1)] = ring[i & (ring.size() - 1)];
+
+    ring.swap(bigger);
+  }
+
+  void TokenStream::fill(size_t index) {
+    while(!ended && last <= index) {
+      if(last - first == ring.size())
+        grow();
+
+      Token &tok = ring[last & (ring.size() - 1)];
+
+      tok = lexer.nextToken();
+      ended = tok.type == Type::EndOfFile;
+      ++last;
+    }
+  }
+
+  const Token &TokenStream::at(size_t index) {
+    if(index < first)
+      throw std::out_of_range("Token was already released");
+
+    fill(index);
+
+    return ring[std::min(index, last - 1) & (ring.size() - 1)];
+  }
+
+  void TokenStream::release(size_t index) {
+    first = std::max(first, std::min(index, last));
+  }
+
+  size_t TokenStream::count() const {
+    return last;
+  }
+}
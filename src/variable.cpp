@@ -6,44 +6,40 @@ using namespace std;
 using namespace AST;
 using namespace Parser;
 
-Variable::Variable(VariableNode *node_, size_t stoffset, AssemblerType atype)
-  : node(node_), asmtype(atype), stackOffset(stoffset + asmtype.size), arraySizeInBytes(0) {
+Variable::Variable(const Tree &tree, VariableNode *node_, size_t stoffset, const AssemblerType &atype)
+  : node(node_), asmtype(&atype), stackOffset(stoffset + atype.size), arraySizeInBytes(0), isLocal(false) {
   if(node_->modifiers.size() == 0) {
     variableType = VariableType::Variable;
     return;
   }
 
   if(node_->modifiers.size() != 0 &&
-     node_->modifiers[0]->type == NodeType::Value &&
-     static_cast<ValueNode*>(node_->modifiers[0])->value.type != Lexer::Type::Integer) {
-    asmtype = NAT_ASMTYPE;
+     node_->modifiers[0].type() == NodeType::Value &&
+     tree.value(node_->modifiers[0]).value.type != Lexer::Type::Integer) {
+    asmtype = &NAT_ASMTYPE;
     variableType = VariableType::Variable;
     return;
   }
 
   variableType = VariableType::StaticArray;
+  size_t arraySize = 1;
 
   for(auto i : node_->modifiers) {
-    if(i->type != NodeType::BinaryOperator) {
-      if(static_cast<ValueNode*>(i)->value.operatorType == Lexer::OperatorType::At)
-        asmtype = NAT_ASMTYPE;
+    if(i.type() != NodeType::BinaryOperator) {
+      if(tree.value(i).value.operatorType == Lexer::OperatorType::At)
+        asmtype = &NAT_ASMTYPE;
 
       break;
     }
 
-    auto val = static_cast<BinaryNode*>(i)->right;
+    auto val = tree.binary(i).right;
 
-    if(val->type != NodeType::Value)
-      throw Error(i->begin, "Array dimension isn't compile-time constant");
+    if(val.type() != NodeType::Value)
+      throw Error(tree.begin(i), "Array dimension isn't compile-time constant");
 
-    dimensionsSize.push_back(stoul(static_cast<ValueNode*>(val)->value.value));
+    arraySize *= static_cast<size_t>(tree.value(val).value.integer);
   }
-  
-  size_t arraySize = 1;
-
-  for(auto i : dimensionsSize)
-    arraySize *= i;
 
-  arraySizeInBytes = arraySize * asmtype.size;
+  arraySizeInBytes = arraySize * asmtype->size;
   stackOffset = arraySizeInBytes + stoffset;
 }